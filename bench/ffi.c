@@ -0,0 +1,154 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// Measure loading YS files through libys the way the bindings with a C shim
+// (erlang, elixir, r and the others) do: ys_ffi_load_buffer_json from the
+// shared libys-ffi helper, on a pool of long-lived isolates.
+//
+// For each file it reports the per call latency of one thread calling over
+// and over, and the throughput of BENCH_THREADS threads calling at once
+// (each on its own isolate of the pool).
+//
+// Usage: ffi <libys-library> <file>...
+//
+// BENCH_RUNS (default 20) is the number of measured calls per thread, after
+// BENCH_WARMUP (default 5) calls that aren't measured. The result is one
+// JSON object on stdout.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libys_ffi.h"
+
+static ys_ffi_pool *pool;
+static int runs, warmup;
+
+struct input {
+  const char *name;
+  char *data;
+  size_t length;
+};
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static int env_int(const char *name, int value) {
+  const char *s = getenv(name);
+  return s != NULL && atoi(s) > 0 ? atoi(s) : value;
+}
+
+static int read_file(const char *name, struct input *input) {
+  FILE *file = fopen(name, "rb");
+  if (file == NULL) return -1;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  input->name = name;
+  input->data = malloc(size > 0 ? size : 1);
+  input->length =
+    input->data != NULL ? fread(input->data, 1, size, file) : 0;
+  fclose(file);
+  return input->data != NULL && (long)input->length == size ? 0 : -1;
+}
+
+// Load an input once and return 0, or -1 if libys responds with an error:
+static int load(const struct input *input) {
+  size_t len;
+  char *json = ys_ffi_load_buffer_json(
+    pool, input->data, input->length, NULL, NULL, &len);
+  int rc = json != NULL && strncmp(json, "{\"error\"", 8) != 0 ? 0 : -1;
+  if (rc != 0)
+    fprintf(stderr, "Loading '%s' failed: %s\n",
+      input->name, json != NULL ? json : "Out of memory");
+  free(json);
+  return rc;
+}
+
+static void *load_runs(void *arg) {
+  const struct input *input = arg;
+  for (int i = 0; i < runs; i++)
+    if (load(input) != 0) return (void *)1;
+  return NULL;
+}
+
+static int bench(const struct input *input, int threads, int last) {
+  double *ms = malloc(runs * sizeof(double));
+  if (ms == NULL) return -1;
+
+  for (int i = 0; i < warmup; i++)
+    if (load(input) != 0) return -1;
+  double sum = 0;
+  for (int i = 0; i < runs; i++) {
+    double start = now_ms();
+    if (load(input) != 0) return -1;
+    ms[i] = now_ms() - start;
+    sum += ms[i];
+  }
+  qsort(ms, runs, sizeof(double), compare);
+
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (ids == NULL) return -1;
+  double start = now_ms();
+  for (int i = 0; i < threads; i++)
+    pthread_create(&ids[i], NULL, load_runs, (void *)input);
+  int failed = 0;
+  for (int i = 0; i < threads; i++) {
+    void *rc;
+    pthread_join(ids[i], &rc);
+    failed |= rc != NULL;
+  }
+  double wall = now_ms() - start;
+  if (failed) return -1;
+
+  printf("    {\"file\": \"%s\", \"bytes\": %zu, \"runs\": %d,"
+    " \"mean-ms\": %.3f, \"min-ms\": %.3f, \"p50-ms\": %.3f,"
+    " \"p90-ms\": %.3f, \"threads\": %d, \"calls-per-sec\": %.1f}%s\n",
+    input->name, input->length, runs, sum / runs, ms[0], ms[runs / 2],
+    ms[runs * 9 / 10], threads, threads * runs * 1000.0 / wall,
+    last ? "" : ",");
+  free(ids);
+  free(ms);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <libys-library> <file>...\n", argv[0]);
+    return 2;
+  }
+  runs = env_int("BENCH_RUNS", 20);
+  warmup = env_int("BENCH_WARMUP", 5);
+  int threads = env_int("BENCH_THREADS", 4);
+
+  if (ys_ffi_open(YAMLSCRIPT_VERSION, argv[1]) != 0) {
+    fprintf(stderr, "%s\n", ys_ffi_error());
+    return 1;
+  }
+  pool = ys_ffi_pool_create(threads);
+  if (pool == NULL) return 1;
+
+  printf("{\n  \"version\": \"%s\",\n  \"threads\": %d,\n"
+    "  \"benchmarks\": [\n", YAMLSCRIPT_VERSION, threads);
+  for (int i = 2; i < argc; i++) {
+    struct input input;
+    if (read_file(argv[i], &input) != 0) {
+      fprintf(stderr, "Can't read '%s'\n", argv[i]);
+      return 1;
+    }
+    if (bench(&input, threads, i == argc - 1) != 0) return 1;
+    free(input.data);
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
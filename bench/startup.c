@@ -0,0 +1,115 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// Measure the startup cost that every short lived YS user pays before any
+// of their code runs:
+//
+// * ys-e-1: running `ys -e 1` (process start to exit)
+// * create-isolate: graal_create_isolate plus graal_tear_down_isolate in
+//   libys, which is what a binding that takes a fresh isolate per call pays
+//
+// The SCI context and its namespace and class tables are built when the
+// native images are built (see NATIVE-OPTS in common/native.mk), so both
+// numbers should stay close to those of an empty native image.
+//
+// Usage: startup <ys-binary> <libys-library> [runs]
+//
+// The result is one JSON object on stdout.
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef int (*create_isolate_fn)(void *, void **, void **);
+typedef int (*isolate_thread_fn)(void *);
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *ms, int runs, int last) {
+  double sum = 0;
+  for (int i = 0; i < runs; i++) sum += ms[i];
+  qsort(ms, runs, sizeof(double), compare);
+  printf("  \"%s\": {\"runs\": %d, \"min-ms\": %.3f, \"median-ms\": %.3f,"
+    " \"mean-ms\": %.3f}%s\n",
+    name, runs, ms[0], ms[runs / 2], sum / runs, last ? "" : ",");
+}
+
+static int run_ys(const char *ys) {
+  pid_t pid = fork();
+  if (pid < 0) return -1;
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDOUT_FILENO);
+    execl(ys, ys, "-e", "1", (char *)NULL);
+    _exit(127);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) < 0) return -1;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <ys-binary> <libys-library> [runs]\n",
+      argv[0]);
+    return 2;
+  }
+  int runs = argc > 3 ? atoi(argv[3]) : 20;
+  if (runs < 1) runs = 1;
+  double *ms = malloc(runs * sizeof(double));
+  if (ms == NULL) return 1;
+
+  printf("{\n");
+
+  for (int i = 0; i < runs; i++) {
+    double start = now_ms();
+    if (run_ys(argv[1]) != 0) {
+      fprintf(stderr, "Running '%s -e 1' failed\n", argv[1]);
+      return 1;
+    }
+    ms[i] = now_ms() - start;
+  }
+  report("ys-e-1", ms, runs, 0);
+
+  void *lib = dlopen(argv[2], RTLD_NOW);
+  if (lib == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 1;
+  }
+  create_isolate_fn create_isolate =
+    (create_isolate_fn)dlsym(lib, "graal_create_isolate");
+  isolate_thread_fn tear_down_isolate =
+    (isolate_thread_fn)dlsym(lib, "graal_tear_down_isolate");
+  if (create_isolate == NULL || tear_down_isolate == NULL) {
+    fprintf(stderr, "'%s' is not a GraalVM native library\n", argv[2]);
+    return 1;
+  }
+  for (int i = 0; i < runs; i++) {
+    void *isolate, *thread;
+    double start = now_ms();
+    if (create_isolate(NULL, &isolate, &thread) != 0) {
+      fprintf(stderr, "graal_create_isolate failed\n");
+      return 1;
+    }
+    tear_down_isolate(thread);
+    ms[i] = now_ms() - start;
+  }
+  report("create-isolate", ms, runs, 1);
+
+  printf("}\n");
+  free(ms);
+  return 0;
+}
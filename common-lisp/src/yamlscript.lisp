@@ -1,6 +1,6 @@
 (defpackage #:yamlscript
   (:use #:cl)
-  (:export #:load-json))
+  (:export #:load-json #:load-file-json))
 
 (in-package #:yamlscript)
 
@@ -16,3 +16,15 @@
                     :wait t)))
         (unless (zerop (sb-ext:process-exit-code proc))
           (error "yamlscript helper failed"))))))
+
+;; libys reads the file itself, so it is not copied through the helper:
+(defun load-file-json (path)
+  (with-output-to-string (out)
+    (let ((proc (sb-ext:run-program
+                  "./bin/yamlscript-lisp-json"
+                  (list (namestring path))
+                  :output out
+                  :error *error-output*
+                  :wait t)))
+      (unless (zerop (sb-ext:process-exit-code proc))
+        (error "yamlscript helper failed")))))
@@ -11,6 +11,37 @@ endif
 
 build-doc:: $(YS)
 
+# Bindings with a C shim set LIBYS-FFI-DIR to their C source directory
+# before including this file. The shared libys-ffi helper sources are
+# copied there, so that each binding package is self-contained:
+ifdef LIBYS-FFI-DIR
+LIBYS-FFI := \
+  $(LIBYS-FFI-DIR)/libys_ffi.c \
+  $(LIBYS-FFI-DIR)/libys_ffi.h \
+
+build:: $(LIBYS-FFI)
+
+$(LIBYS-FFI-DIR)/libys_ffi.c: $(COMMON)/libys-ffi/libys_ffi.c
+	cp $< $@
+
+$(LIBYS-FFI-DIR)/libys_ffi.h: $(COMMON)/libys-ffi/libys_ffi.h
+	cp $< $@
+
+# The NIF bindings (elixir and erlang) also set LIBYS-FFI-NIF, for the
+# shared CBOR to BEAM term decoder:
+ifdef LIBYS-FFI-NIF
+LIBYS-FFI += \
+  $(LIBYS-FFI-DIR)/libys_ffi_nif.c \
+  $(LIBYS-FFI-DIR)/libys_ffi_nif.h \
+
+$(LIBYS-FFI-DIR)/libys_ffi_nif.c: $(COMMON)/libys-ffi/libys_ffi_nif.c
+	cp $< $@
+
+$(LIBYS-FFI-DIR)/libys_ffi_nif.h: $(COMMON)/libys-ffi/libys_ffi_nif.h
+	cp $< $@
+endif
+endif
+
 clean::
 	$(RM) *.tmp
 
@@ -6,7 +6,7 @@ ROOT := $(shell \
 YAMLSCRIPT_VERSION := 0.2.31
 
 YS-FILES := $(filter-out %-build-report.html,\
-	$(wildcard ys ys.exe ys-[0-9]* ys-sh-[0-9]*))
+	$(wildcard ys ys.exe ys-[0-9]* ys-sh-[0-9]* ys-client-[0-9]*))
 YS := $(firstword $(YS-FILES))
 LIBYS := $(firstword $(wildcard libys.so* libys.dylib* libys.dll))
 LIBYS-FILES := $(wildcard libys.so* libys.dylib* libys.dll)
@@ -13,6 +13,9 @@ CLI-SRC := \
 CLI-BIN-BASH := bin/ys-sh-$(YS_VERSION)
 CLI-BIN-BASH-SRC := share/ys-0.bash
 
+CLI-BIN-CLIENT := bin/ys-client-$(YS_VERSION)
+CLI-BIN-CLIENT-SRC := share/ys-client.c
+
 CLI-JAR := \
   target/uberjar/yamlscript.cli-$(YS_VERSION)-SNAPSHOT-standalone.jar
 
@@ -28,6 +31,10 @@ CLI-DEPS := \
   $(CLI-BIN) \
   $(CLI-BIN-BASH) \
 
+ifneq ($(OS-NAME),windows)
+CLI-DEPS += $(CLI-BIN-CLIENT)
+endif
+
 ifdef YS_NATIVE_BUILD_STATIC
 ifeq (true,$(IS-LINUX))
 ifeq (true,$(IS-INTEL))
@@ -0,0 +1,140 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+;; The yamlscript.bench program measures the compiler and runtime on the JVM,
+;; for `make bench-compile` (see bench/ReadMe.md).
+;;
+;; For each YS file it times, after a warmup:
+;;
+;; * compile: every compiler stage, with no compile cache
+;; * each stage (parse, compose, resolve, build, transform, construct and
+;;   print), summed over the file's documents
+;; * eval: evaluating the file's compiled forms, like `ys -l` does after
+;;   compiling
+;;
+;; It also times the per call cost of yaml/load on a small string, with the
+;; clj-yaml backend resolved once (ys.v0.util/backend) and resolved on every
+;; call (as backend did before it cached).
+;;
+;; BENCH_RUNS (default 20) and BENCH_WARMUP (default 5) set the number of
+;; measured and warmup runs. The result is one JSON object on stdout.
+
+(ns yamlscript.bench
+  (:require
+   [clojure.data.json :as json]
+   [clojure.set :as set]
+   [yamlscript.compiler :as compiler]
+   [yamlscript.profile :as profile]
+   [yamlscript.runtime :as runtime]
+   [ys.v0.util :as util]
+   [ys.v0.yaml :as yaml])
+  (:import
+   (java.io Writer))
+  (:refer-clojure))
+
+(def stages
+  ["parse" "compose" "resolve" "build" "transform" "construct" "print"])
+
+(defn- env-int [name default]
+  (let [n (some-> (System/getenv name) parse-long)]
+    (if (and n (pos? n)) n default)))
+
+(defn- millis [nanos]
+  (/ nanos 1000000.0))
+
+(defn- round [ms]
+  (/ (Math/round (* ms 1000.0)) 1000.0))
+
+(defn- summarize
+  "Return the stats of a seq of run times in ms."
+  [times]
+  (let [times (vec (sort times))
+        n (count times)
+        mean (/ (reduce + times) n)]
+    {:runs n
+     :mean-ms (round mean)
+     :min-ms (round (first times))
+     :p50-ms (round (nth times (quot n 2)))
+     :p90-ms (round (nth times (quot (* n 9) 10)))
+     :ops-per-sec (round (if (pos? mean) (/ 1000.0 mean) 0.0))}))
+
+(defn- measure
+  "Call f warmup times, then runs times, and return the ms that each of the
+  measured calls took."
+  [f warmup runs]
+  (dotimes [_ warmup] (f))
+  (vec
+    (for [_ (range runs)]
+      (let [start (System/nanoTime)]
+        (f)
+        (millis (- (System/nanoTime) start))))))
+
+(defn- stage-times
+  "Compile ys with profiling on and return the ms of each stage, summed over
+  its documents."
+  [ys]
+  (binding [profile/*profile* (profile/start)]
+    (compiler/compile ys)
+    (reduce
+      (fn [times document]
+        (reduce-kv
+          (fn [times stage {:keys [ms]}]
+            (update times stage (fnil + 0) ms))
+          times document))
+      {} (:documents @profile/*profile*))))
+
+(defn- bench-file [path warmup runs]
+  (let [ys (slurp path)
+        compile-ms (measure #(compiler/compile-uncached ys) warmup runs)
+        _ (dotimes [_ warmup] (stage-times ys))
+        stage-ms (vec (repeatedly runs #(stage-times ys)))
+        forms (compiler/compile-forms ys)
+        eval-ms (binding [*out* (Writer/nullWriter)]
+                  (measure #(runtime/eval-code forms path) warmup runs))]
+    {:file path
+     :bytes (count (.getBytes ^String ys "UTF-8"))
+     :compile (summarize compile-ms)
+     :stages (into {}
+               (for [stage stages]
+                 [stage (summarize (map #(get %1 stage 0) stage-ms))]))
+     :eval (summarize eval-ms)}))
+
+(def ^:private calls 10000)
+
+(def ^:private small-yaml "name: web\nport: 8080\ntags: [a, b]\n")
+
+(defn- per-call-ns
+  "Return the ns per call of f, summarized over runs of calls calls."
+  [f warmup runs]
+  (-> (measure #(dotimes [_ calls] (f)) warmup runs)
+    summarize
+    (select-keys [:mean-ms :min-ms :p50-ms])
+    (update-vals #(round (/ (* %1 1000000.0) calls)))
+    (set/rename-keys {:mean-ms :mean-ns :min-ms :min-ns :p50-ms :p50-ns})))
+
+(defn- bench-backend [warmup runs]
+  (let [sym 'clj-yaml.core/parse-string
+        uncached #(do (require (symbol (namespace sym))) (resolve sym))]
+    {:backend-cached (per-call-ns #(util/backend sym) warmup runs)
+     :backend-uncached (per-call-ns uncached warmup runs)
+     :yaml-load (per-call-ns #(yaml/load small-yaml) warmup runs)
+     :yaml-load-uncached
+     (per-call-ns
+       #((uncached) small-yaml
+          :code-point-limit (* 10 1024 1024)
+          :keywords false)
+       warmup runs)}))
+
+(defn -main [& paths]
+  (let [warmup (env-int "BENCH_WARMUP" 5)
+        runs (env-int "BENCH_RUNS" 20)]
+    (json/pprint
+      {:version runtime/ys-version
+       :warmup warmup
+       :benchmarks (mapv #(bench-file %1 warmup runs) paths)
+       :backend (bench-backend warmup runs)})
+    (shutdown-agents)
+    (System/exit 0)))
+
+(comment
+  )
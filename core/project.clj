@@ -58,4 +58,7 @@
      (do
        (require 'pjstadig.humane-test-output)
        (pjstadig.humane-test-output/activate!)
-       (require 'yamlscript.test-runner))}}})
+       (require 'yamlscript.test-runner))}}
+
+   :bench
+   {:source-paths ["bench"]}})
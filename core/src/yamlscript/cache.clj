@@ -3,12 +3,18 @@
 
 ;; The yamlscript.cache namespace stores remote module content under a stable
 ;; key so repeated `use :url ...` loads do not refetch the same source.
+;;
+;; It also caches compiled Clojure code by a hash of its YS source (see
+;; compiled), in memory and optionally on disk, so that compiling unchanged
+;; code again skips the compiler entirely.
 
 (ns yamlscript.cache
   (:require
    [babashka.fs :as fs]
    [babashka.http-client :as http]
    [clj-commons.digest :as digest])
+  (:import
+   (java.util Iterator LinkedHashMap Map$Entry))
   (:refer-clojure :exclude [get set]))
 
 (defn ys-cache
@@ -43,6 +49,150 @@
     (spit cache val)
     val))
 
+(defn compile-cache-mode
+  "Return the YS_COMPILE_CACHE mode: :off (\"0\"), :disk (\"disk\", memory and
+  on-disk) or :memory (the default)."
+  []
+  (case (System/getenv "YS_COMPILE_CACHE")
+    "0" :off
+    "disk" :disk
+    :memory))
+
+(def compile-cache-size
+  "The most compiled results kept in memory (YS_COMPILE_CACHE_SIZE)."
+  (delay
+    (or (some-> (System/getenv "YS_COMPILE_CACHE_SIZE") parse-long)
+      256)))
+
+(def compile-cache-bytes
+  "The most bytes of source and compiled code kept in memory
+  (YS_COMPILE_CACHE_BYTES)."
+  (delay
+    (or (some-> (System/getenv "YS_COMPILE_CACHE_BYTES") parse-long)
+      (* 16 1024 1024))))
+
+(def compile-stats
+  "Compile cache counters: memory hits, disk hits and misses."
+  (atom {:hits 0 :disk-hits 0 :misses 0}))
+
+;; The in-memory LRU cache maps keys to [value bytes]. It is a LinkedHashMap
+;; in access order, so its first entry is always the least recently used one
+;; and is the one dropped when the cache is over either limit. It is only
+;; used while holding its lock, and lru-bytes is the total of its entries:
+(defonce ^:private ^LinkedHashMap compiled-lru (LinkedHashMap. 16 0.75 true))
+(defonce ^:private lru-bytes (atom 0))
+
+(defn- lru-get [key]
+  (locking compiled-lru
+    (first (.get compiled-lru key))))
+
+;; An entry bigger than the whole cache is not kept:
+(defn- lru-put [k v bytes]
+  (when (<= bytes @compile-cache-bytes)
+    (locking compiled-lru
+      (when-let [[_ old] (.put compiled-lru k [v bytes])]
+        (swap! lru-bytes - old))
+      (swap! lru-bytes + bytes)
+      (let [^Iterator entries (.iterator (.entrySet compiled-lru))]
+        (while (or (> (.size compiled-lru) @compile-cache-size)
+                 (> @lru-bytes @compile-cache-bytes))
+          (let [^Map$Entry entry (.next entries)]
+            (swap! lru-bytes - (second (.getValue entry)))
+            (.remove entries))))))
+  v)
+
+(defn- entry-bytes
+  "Return the bytes that a compiled result for source (the compiled key)
+  holds in memory, counting 2 per char. Compiled forms are counted as the
+  size of their source."
+  [source val]
+  (* 2 (+ (count source)
+         (if (string? val) (count val) (count source)))))
+
+;; Compiled code read from disk is evaluated, so the directory must be one
+;; that no other user can write to. It is $YS_CACHE/compile if YS_CACHE is
+;; set, else per user ($XDG_CACHE_HOME/ys/compile or ~/.cache/ys/compile),
+;; never the shared /tmp/ys-cache.
+(defn- compile-cache-path []
+  (str
+    (or (System/getenv "YS_CACHE")
+      (str (or (System/getenv "XDG_CACHE_HOME")
+             (str (System/getProperty "user.home") "/.cache"))
+        "/ys"))
+    "/compile"))
+
+;; Windows owners are named DOMAIN\user:
+(defn- own? [path]
+  (= (System/getProperty "user.name")
+    (re-find #"[^\\]+$"
+      (.getName ^java.nio.file.attribute.UserPrincipal (fs/owner path)))))
+
+(def ^:private compile-cache-dir
+  "The on-disk compile cache directory, created with mode 0700 on first use,
+  or nil if it or its parent is owned by another user. A directory of ours
+  has its mode set to 0700 too."
+  (delay
+    (try
+      (let [dir (compile-cache-path)
+            posix (contains?
+                    (.supportedFileAttributeViews
+                      (java.nio.file.FileSystems/getDefault))
+                    "posix")]
+        (when-not (fs/exists? dir)
+          (fs/create-dirs dir))
+        (when (and (own? dir) (own? (fs/parent (fs/absolutize dir))))
+          (when posix
+            (fs/set-posix-file-permissions dir "rwx------"))
+          dir))
+      (catch Exception _ nil))))
+
+(defn- disk-path [key]
+  (when-let [dir @compile-cache-dir]
+    (str dir "/" key ".clj")))
+
+;; The disk cache is only an optimization, so failing to read or write it is
+;; the same as a miss:
+(defn- disk-get [key]
+  (try
+    (let [path (disk-path key)]
+      (when (and path (fs/exists? path))
+        (slurp path)))
+    (catch Exception _ nil)))
+
+;; Write to a temporary file and move it into place, so that concurrent ys
+;; processes never read a partly written entry:
+(defn- disk-put [key val]
+  (try
+    (when-let [path (disk-path key)]
+      (let [temp (str path "." (random-uuid))]
+        (spit temp val)
+        (fs/move temp path {:replace-existing true :atomic-move true})))
+    (catch Exception _ nil))
+  val)
+
+(defn compiled
+  "Return the cached compile result for source (a string holding the YS
+  source and everything else that affects its compiled code), or call
+  compile-fn and cache its result. The in-memory cache keeps at most
+  compile-cache-size results and compile-cache-bytes bytes, dropping the
+  least recently used results first."
+  [source compile-fn]
+  (let [mode (compile-cache-mode)
+        key (when-not (= :off mode) (digest/sha-256 source))]
+    (if-not key
+      (compile-fn)
+      (if-let [val (lru-get key)]
+        (do (swap! compile-stats update :hits inc)
+            val)
+        (if-let [val (and (= :disk mode) (disk-get key))]
+          (do (swap! compile-stats update :disk-hits inc)
+              (lru-put key val (entry-bytes source val)))
+          (let [val (compile-fn)]
+            (swap! compile-stats update :misses inc)
+            (when (= :disk mode)
+              (disk-put key val))
+            (lru-put key val (entry-bytes source val))))))))
+
 (defn curl
   "Fetch a URL through curl, caching the response by URL."
   [url]
@@ -14,53 +14,269 @@
    [clojure.edn]
    [clojure.string :as str]
    [yamlscript.builder]
+   [yamlscript.cache]
+   [ys.v0]
    [ys.v0.common]
+   [ys.v0.global]
    [yamlscript.composer]
    [yamlscript.constructor]
+   [yamlscript.emitter]
    [yamlscript.global]
    [yamlscript.parser]
    [yamlscript.printer]
+   [yamlscript.profile :as profile]
    [yamlscript.resolver]
    [yamlscript.transformer])
+  (:import
+   (java.util.concurrent ExecutionException ExecutorService Executors Future
+                         ThreadFactory))
   (:refer-clojure :exclude [compile]))
 
+(defn- doc-event? [ev]
+  (= "DOC" (subs (:+ ev) 1)))
+
+(defn- split-group
+  "Take the events of one YAML document from events, up to the next +DOC.
+  Return [group more], where group is a vector of the document's events
+  without its boundary events and more starts at the next +DOC (if any).
+  Only the events of this document are realized."
+  [events]
+  (loop [group [], events events]
+    (let [s (seq events)
+          ev (first s)]
+      (if (or (nil? s) (= "+DOC" (:+ ev)))
+        [group s]
+        (recur (if (doc-event? ev) group (conj group ev)) (rest s))))))
+
 (defn parse-events-to-groups
-  "Split parser events into one event group per YAML document."
+  "Split parser events into a lazy seq of event groups, one per YAML
+  document."
   [events]
-  (->> events
-    (reduce
-      (fn [acc ev]
-        (if (= (:+ ev) "+DOC")
-          (conj acc [ev])
-          (update acc (dec (count acc)) conj ev)))
-      [[]])
-    (map #(remove (fn [ev] (= "DOC" (subs (:+ ev) 1))) %1))))
+  (lazy-seq
+    (let [[group more] (split-group events)]
+      (cons group
+        (when more
+          (parse-events-to-groups (rest more)))))))
 
-(defn compile
-  "Convert YAMLScript code string to an equivalent Clojure code string."
-  [^String yamlscript-string]
+(defn- compose-documents
+  "Compose parser events into a lazy seq of [node ctx] pairs, one per YAML
+  document. Composing carries ctx from one document to the next. A document
+  is composed as soon as its events are in; the parser has only read as far
+  as the start of the next one."
+  [events ctx i]
+  (lazy-seq
+    (let [[group more] (split-group events)
+          ctx (assoc ctx
+                :first (= i 1)
+                :last (nil? more))
+          [node ctx] (yamlscript.composer/compose group ctx)]
+      (cons [node ctx]
+        (when more
+          (compose-documents (rest more) ctx (inc i)))))))
+
+(defn construct-node
+  "Run the stages after compose up to construct on one composed document
+  node, returning its Clojure AST."
+  [node ctx]
+  (-> node
+    yamlscript.resolver/resolve
+    yamlscript.builder/build
+    yamlscript.transformer/transform
+    (yamlscript.constructor/construct ctx)))
+
+(defn compile-node
+  "Run the stages after compose on one composed document node, returning its
+  Clojure code string."
+  [node ctx]
+  (yamlscript.printer/print (construct-node node ctx)))
+
+(defn emit-node
+  "Run the stages after compose on one composed document node, returning its
+  Clojure forms (see yamlscript.emitter/emit)."
+  [node ctx]
+  (yamlscript.emitter/emit (construct-node node ctx)))
+
+(def compile-threads
+  "Threads used to compile the documents of a multi-document stream
+  (YS_COMPILE_THREADS, default one per core). 1 compiles them in turn."
+  (delay
+    (or (some-> (System/getenv "YS_COMPILE_THREADS") parse-long)
+      (.availableProcessors (Runtime/getRuntime)))))
+
+;; Streams with fewer documents than this are not worth handing out:
+(def ^:private parallel-min-docs 4)
+
+(def ^:private compile-executor
+  (delay
+    (let [n (atom 0)]
+      (Executors/newFixedThreadPool
+        @compile-threads
+        (reify ThreadFactory
+          (newThread [_ runnable]
+            (doto (Thread. ^Runnable runnable
+                    (str "ys-compile-" (swap! n inc)))
+              (.setDaemon true))))))))
+
+;; True on a compile thread, where a nested compile must not wait on the
+;; same fixed pool:
+(def ^:private ^:dynamic *compile-task* false)
+
+(defn- compile-nodes
+  "Compile composed [node ctx] pairs with compile-fn (like compile-node), in
+  order. The documents of big streams are compiled concurrently on a fixed
+  pool."
+  [compile-fn nodes]
+  (if (or *compile-task*
+        (< (count nodes) parallel-min-docs)
+        (<= @compile-threads 1))
+    (mapv #(apply compile-fn %1) nodes)
+    (let [task (bound-fn [node ctx]
+                 (binding [*compile-task* true]
+                   (compile-fn node ctx)))
+          futures (mapv (fn [[node ctx]]
+                          (.submit ^ExecutorService @compile-executor
+                            ^Callable #(task node ctx)))
+                    nodes)]
+      ;; Rethrow the first failure in document order, like a sequential
+      ;; compile would:
+      (try
+        (mapv #(.get ^Future %1) futures)
+        (catch ExecutionException e
+          (run! #(.cancel ^Future %1 true) futures)
+          (throw (.getCause e)))))))
+
+(defn- compile-batches
+  "Lazily compile [node ctx] pairs with compile-fn, size documents at a
+  time."
+  [compile-fn nodes size]
+  (lazy-seq
+    (when (seq nodes)
+      (let [[batch more] (split-at size nodes)]
+        (concat (compile-nodes compile-fn (vec batch))
+          (compile-batches compile-fn more size))))))
+
+(defn- stream-documents
+  "Lazily compile each YAML document of YAMLScript code with compile-fn."
+  [compile-fn yamlscript]
+  (let [size (if (or *compile-task* (<= @compile-threads 1))
+               1
+               (max parallel-min-docs (* 2 @compile-threads)))]
+    (compile-batches compile-fn
+      (-> yamlscript
+        yamlscript.parser/parse
+        (compose-documents {:first nil :last nil :init nil} 1))
+      size)))
+
+(defn compile-stream
+  "Convert YAMLScript code (a string or a java.io.Reader) to a lazy seq of
+  Clojure code strings, one per YAML document. Events are pulled from the
+  parser as the blocks are consumed, so only the document being compiled (or
+  a batch of documents when they are compiled concurrently) is ever held in
+  memory, not the whole stream."
+  [yamlscript]
+  (stream-documents compile-node yamlscript))
+
+(defn compile-uncached
+  "Convert YAMLScript code (a string or a java.io.Reader) to an equivalent
+  Clojure code string, running every compiler stage."
+  [yamlscript-string]
   (when (System/getenv "YS_SHOW_PARSER_INPUT")
     (WWW "parser-input" yamlscript-string))
-  (let [events (yamlscript.parser/parse yamlscript-string)
-        groups (parse-events-to-groups events)
-        n (count groups)
-        ctx {:first nil :last nil :init nil}
-        blocks (loop [[events & groups] groups, ctx ctx, blocks [], i 1]
-                 (let [ctx (assoc ctx
-                             :first (= i 1)
-                             :last (>= i n))
-                       [node ctx] (yamlscript.composer/compose events ctx)
-                       blocks (conj blocks
-                                (-> node
-                                  yamlscript.resolver/resolve
-                                  yamlscript.builder/build
-                                  yamlscript.transformer/transform
-                                  (yamlscript.constructor/construct ctx)
-                                  yamlscript.printer/print))]
-                   (if (seq groups)
-                     (recur groups ctx blocks (inc i))
-                     blocks)))]
-    (str/join "" blocks)))
+  (let [out (StringBuilder.)]
+    (run! #(.append out ^String %1) (compile-stream yamlscript-string))
+    (str out)))
+
+(def ^:private show-vars
+  "Env vars that print compiler internals, which a cache hit would skip."
+  ["YS_SHOW_PARSER_INPUT" "YS_SHOW_LEX" "YS_SHOW_INPUT"])
+
+(defn- compile-key
+  "Return the compile cache key for YS source: the source and everything else
+  that changes the code it compiles to, starting with the ys version so that
+  an upgrade never reads back code compiled by an older ys."
+  [source]
+  (str ys.v0/VERSION " "
+    (pr-str (select-keys @ys.v0.global/opts
+              [:compile :unordered :xtrace])) " "
+    yamlscript.constructor/no-wrap "\n"
+    source))
+
+(defn- compile-profiled
+  "Compile like compile-uncached, one document at a time on this thread, and
+  record every stage of every document in the current profile."
+  [yamlscript]
+  (let [out (StringBuilder.)]
+    (loop [events nil, ctx {:first nil :last nil :init nil}, i 1]
+      (profile/document)
+      (let [[group more] (profile/measure "parse"
+                           #(split-group
+                              (if (= 1 i)
+                                (yamlscript.parser/parse yamlscript)
+                                events))
+                           first)
+            ctx (assoc ctx
+                  :first (= i 1)
+                  :last (nil? more))
+            [node ctx] (profile/measure "compose"
+                         #(yamlscript.composer/compose group ctx)
+                         first)
+            code (reduce
+                   (fn [node [stage stage-fn]]
+                     (profile/measure stage #(stage-fn node)))
+                   node
+                   [["resolve" yamlscript.resolver/resolve]
+                    ["build" yamlscript.builder/build]
+                    ["transform" yamlscript.transformer/transform]
+                    ["construct" #(yamlscript.constructor/construct %1 ctx)]
+                    ["print" yamlscript.printer/print]])]
+        (.append out ^String code)
+        (if more
+          (recur (rest more) ctx (inc i))
+          (str out))))))
+
+(defn compile
+  "Convert YAMLScript code (a string or a java.io.Reader) to an equivalent
+  Clojure code string. Results for string input are cached (see
+  yamlscript.cache/compiled); a reader can only be read once, so reader input
+  is always compiled. While profiling (see yamlscript.profile) every stage is
+  run and recorded."
+  [yamlscript]
+  (cond
+    profile/*profile* (compile-profiled yamlscript)
+    (and (string? yamlscript)
+      (not (some #(System/getenv %1) show-vars)))
+    (yamlscript.cache/compiled (compile-key yamlscript)
+      #(compile-uncached yamlscript))
+    :else (compile-uncached yamlscript)))
+
+(defn- forms-uncached [yamlscript]
+  (when (System/getenv "YS_SHOW_PARSER_INPUT")
+    (WWW "parser-input" yamlscript))
+  (into [] cat (stream-documents emit-node yamlscript)))
+
+(defn compile-forms
+  "Convert YAMLScript code (a string or a java.io.Reader) to a vector of
+  Clojure forms for yamlscript.runtime/eval-code, without printing them as
+  code and reading that back (see yamlscript.emitter). Forms for string input
+  are cached in memory like compile's code. With the disk compile cache,
+  while profiling, or with the stack-trace option, the code is compiled with
+  compile instead and returned as a single code text item."
+  [yamlscript]
+  (let [cacheable (and (string? yamlscript)
+                    (not (some #(System/getenv %1) show-vars)))]
+    (cond
+      (or profile/*profile*
+        ;; Emitted forms have no reader :line and :column metadata, which
+        ;; SCI puts in the data of the errors a stack trace shows:
+        (:stack-trace @ys.v0.global/opts)
+        (and cacheable (= :disk (yamlscript.cache/compile-cache-mode))))
+      [(yamlscript.emitter/code (compile yamlscript))]
+      ,
+      cacheable
+      (yamlscript.cache/compiled (str "forms\n" (compile-key yamlscript))
+        #(forms-uncached yamlscript))
+      ,
+      :else (forms-uncached yamlscript))))
 
 (defmacro value-time
   "Evaluate body and return its value with the elapsed time string."
@@ -73,7 +289,7 @@
 (defn stage-with-options
   "Run one compiler stage, optionally printing debug output and timing."
   [stage-name stage-fn input-args]
-  (if (get-in @yamlscript.global/opts [:debug-stage stage-name])
+  (if (get-in @ys.v0.global/opts [:debug-stage stage-name])
     (let [[value time] (value-time (apply stage-fn input-args))]
       (printf "*** %-9s *** %s ms\n\n" stage-name time)
       (clojure.pprint/pprint value)
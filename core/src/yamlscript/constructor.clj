@@ -10,7 +10,7 @@
    [clojure.walk :as walk]
    [yamlscript.ast :as ast :refer [Lst Map Qts Str Sym Vec]]
    [ys.v0.common]
-   [yamlscript.global :as global]
+   [ys.v0.global]
    [yamlscript.re :as re])
   (:refer-clojure))
 
@@ -46,7 +46,7 @@
       ((fn [m]
          (update-in m [:Top (dec (count (:Top m)))]
            (fn [n]
-             (let [compile (:compile @global/opts)
+             (let [compile (:compile @ys.v0.global/opts)
                    node (if (or (not n) no-wrap (and last compile))
                           n
                           (Lst [(Sym '+++) n]))]
@@ -516,7 +516,7 @@
   [node]
   (if (vector? node)
     (vec (map maybe-trace node))
-    (if-lets [_ (:xtrace @global/opts)
+    (if-lets [_ (:xtrace @ys.v0.global/opts)
               sym (get-in node [:Lst 0 :Sym])
               _ (not (some #{sym} do-not-trace))]
       (if (some #{sym} cannot-trace)
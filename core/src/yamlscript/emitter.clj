@@ -0,0 +1,137 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+;; The yamlscript.emitter is responsible for converting YS Clojure AST into
+;; Clojure forms, for the runtime to evaluate without the printer turning them
+;; into code text and SCI reading that text back.
+;;
+;; Each form is the one that reading the printer's code would give. The few
+;; nodes whose code depends on reader syntax (raw Clojure, token tuples and
+;; the like) are not converted; the top level form holding one is emitted as
+;; code text (see code) for the runtime to read.
+;;
+;; Emitted forms have no reader :line and :column metadata, so SCI errors
+;; from them have no location. When a stack trace is wanted,
+;; compiler/compile-forms compiles to code text instead.
+
+(ns yamlscript.emitter
+  (:require
+   [clojure.string :as str]
+   [ys.v0.common]
+   [ys.v0.global]
+   [yamlscript.printer :as printer])
+  (:import
+   (clojure.lang RT))
+  (:refer-clojure))
+
+(defrecord Code [text])
+
+(defn code
+  "Wrap Clojure code text, to be read and evaluated in place of a form."
+  [text]
+  (->Code text))
+
+(defn code?
+  "Return true when a form from emit is Clojure code text."
+  [form]
+  (instance? Code form))
+
+(defn- unsupported []
+  (throw (ex-info "Emit as code" {::unsupported true})))
+
+;; Symbol text that the reader reads back as that same symbol:
+(def ^:private plain-symbol
+  #"(?![-+.]?\d)[a-zA-Z*+!_?<>=$%&.|/-][\w*+!?<>=$%&.|/'#-]*")
+
+(defn- emit-symbol [text]
+  (if (and (re-matches plain-symbol text)
+        (not (contains? #{"nil" "true" "false"} text)))
+    (symbol text)
+    (unsupported)))
+
+(def ^:private char-names
+  {"newline" \newline
+   "space" \space
+   "tab" \tab
+   "formfeed" \formfeed
+   "backspace" \backspace
+   "return" \return})
+
+(defn- emit-char [text]
+  (or (char-names text)
+    (when (= 1 (count text)) (first text))
+    (unsupported)))
+
+(declare emit-node)
+
+(defn- emit-map [kvs]
+  (let [kvs (mapv emit-node kvs)]
+    (cond
+      (odd? (count kvs)) (unsupported)
+      ,
+      (:unordered @ys.v0.global/opts)
+      ;; A map literal, checked for duplicate keys like the reader does:
+      (try
+        (RT/map (object-array kvs))
+        (catch IllegalArgumentException _ (unsupported)))
+      ,
+      :else (apply list '% kvs))))
+
+(defn- emit-tuple
+  "A tuple is a reader prefix token and the form it applies to."
+  [[token form :as nodes]]
+  (if (= 2 (count nodes))
+    (case (:Tok token)
+      "'" (list 'quote (emit-node form))
+      "@" (list 'clojure.core/deref (emit-node form))
+      (unsupported))
+    (unsupported)))
+
+(defn emit-node
+  "Convert one Clojure AST node into the Clojure form that reading its printed
+  code would give."
+  [node]
+  (let [node (if (keyword? node) {node true} node)
+        [type val] (first node)]
+    (case type
+      :Lst (apply list (map emit-node val))
+      :Vec (mapv emit-node val)
+      :Set (let [forms (mapv emit-node val)
+                 forms-set (set forms)]
+             (if (= (count forms-set) (count forms))
+               forms-set
+               (unsupported)))
+      :Map (emit-map val)
+      :Str val
+      :Rgx (re-pattern (printer/pr-regex val))
+      :Chr (emit-char (str val))
+      :QSym (list 'quote (emit-symbol (str val)))
+      :Qts (list 'quote (emit-symbol (str val)))
+      :Spc (emit-symbol (str/replace (str val) #"::" "."))
+      :Sym (emit-symbol (printer/pr-symbol (str val)))
+      :Tup (emit-tuple val)
+      :Key (if (keyword? val) val (unsupported))
+      :Int val
+      :Flt val
+      :Num val
+      :Bln val
+      :Nil nil
+      (unsupported))))
+
+(defn emit
+  "Convert a YS AST (as from the constructor) into a vector of Clojure forms,
+  one per top level node. A top level node that can't be converted is printed
+  and wrapped with code instead."
+  [node]
+  (mapv
+    (fn [node]
+      (try
+        (emit-node node)
+        (catch clojure.lang.ExceptionInfo e
+          (if (::unsupported (ex-data e))
+            (code (printer/print-node node))
+            (throw e)))))
+    (or (:Top node) [node])))
+
+(comment
+  )
@@ -14,6 +14,7 @@
    [yamlscript.cache :as cache]
    [yamlscript.deps :as deps]
    [ys.v0.common :refer [abspath dirname get-yspath]]
+   [ys.v0.global]
    [yamlscript.compiler]
    [yamlscript.constructor]
    [yamlscript.global :as G]
@@ -26,7 +27,7 @@
 (defn load-pod
   "Load pod into the YAMLScript runtime."
   [args]
-  (let [pod (apply pods/load-pod @G/sci-ctx args)]
+  (let [pod (apply pods/load-pod (G/context) args)]
     (swap! G/pods conj pod)))
 
 (defn unload-pods
@@ -44,13 +45,13 @@
   [code file]
   (let [code (binding [yamlscript.constructor/no-wrap true]
                (yamlscript.compiler/compile code))
-        stream @G/stream-values
-        _ (reset! G/stream-values [])
+        stream @ys.v0.global/stream-values
+        _ (reset! ys.v0.global/stream-values [])
         ret (sci/binding
              [sci/file file
               G/FILE file]
-              (sci/eval-string+ @G/sci-ctx code))
-        _ (reset! G/stream-values stream)]
+              (sci/eval-string+ (G/context) code))
+        _ (reset! ys.v0.global/stream-values stream)]
     (:val ret)))
 
 (defn load-file-ys
@@ -66,7 +67,7 @@
   (sci/binding
    [sci/file file
     G/FILE file]
-    (:val (sci/eval-string+ @G/sci-ctx code))))
+    (:val (sci/eval-string+ (G/context) code))))
 
 (defn load-file-clj
   "Load file clj into the YAMLScript runtime."
@@ -104,7 +105,7 @@
   "Load yspath into the YAMLScript runtime."
   [modpath yspath]
   (deps/add-roots! yspath)
-  (when (not (sci/find-ns @G/sci-ctx
+  (when (not (sci/find-ns (G/context)
                (symbol (str/replace modpath #"/" "."))))
     (loop [yspath yspath]
       (if (seq yspath)
@@ -169,7 +170,7 @@
     (deps/prepare-required!
       coordinate
       (fn [namespace]
-        (sci/eval-string+ @G/sci-ctx
+        (sci/eval-string+ (G/context)
           (str "(require '" namespace ")")
           {:ns ns}))
       load-file-clj)))
@@ -272,11 +273,11 @@
       (die (str "Dependency namespace '" loaded-namespace
              "' does not match use module '" namespace-sym "'")))
     (let [namespace-sym (symbol module)
-          namespace-object (sci/find-ns @G/sci-ctx namespace-sym)]
+          namespace-object (sci/find-ns (G/context) namespace-sym)]
       (when-not namespace-object
         (die (str "Namespace not found: " namespace-sym)))
       (when-let [as (:as args)]
-        (sci/eval-string+ @G/sci-ctx
+        (sci/eval-string+ (G/context)
           (str "(alias '" as " '" namespace-sym ")")
           {:ns ns}))
       (when-let [syms (:get args)]
@@ -293,10 +294,10 @@
                      (when (seq rename)
                        (str " :rename '" (pr-str rename)))
                      ")")]
-          (sci/eval-string+ @G/sci-ctx code {:ns ns})))
+          (sci/eval-string+ (G/context) code {:ns ns})))
       (when (or (:all args) (:not args))
         (let [syms (some->> (:not args) (map str))]
-          (sci/eval-string+ @G/sci-ctx
+          (sci/eval-string+ (G/context)
             (str "(refer '" namespace-sym
               (when syms
                 (str " :exclude '[" (str/join " " syms) "]"))
@@ -16,15 +16,26 @@
                             resolve]))
 
 (def main-ns (sci/create-ns 'main))
+
+;; The fully initialized SCI context. It is built when the runtime namespace
+;; loads, which for the native ys and libys builds is at image build time.
 (def sci-ctx (atom nil))
 
-;; Portable state re-exports (same atom objects as ys.v0.global)
-(def stream-anchors_ v0/stream-anchors_)
-(def doc-anchors_ v0/doc-anchors_)
-(def stream-values v0/stream-values)
-(def opts v0/opts)
+(def ^:dynamic *fork*
+  "The copy-on-write fork of sci-ctx that the current evaluation runs in (see
+  yamlscript.runtime/with-runtime), or nil."
+  nil)
+
+(defn context
+  "Return the SCI context to evaluate in: the current fork, else sci-ctx."
+  []
+  (or *fork* @sci-ctx))
+
+;; The portable state (the stream values and anchors, opts and env) is in
+;; ys.v0.global. It can be bound per run, so it is used through those vars
+;; rather than re-exported here.
 
-(def pods (atom []))
+(def ^:dynamic pods (atom []))
 (defonce build-xstr (atom nil))
 
 (def _ (sci/new-dynamic-var 'ARGS nil {:ns main-ns}))
@@ -34,7 +45,7 @@
 (defn get-PUN
   "Return PUN for the current context."
   []
-  (sci/eval-string+ @sci-ctx "(var-get (resolve 'PUN))"))
+  (sci/eval-string+ (context) "(var-get (resolve 'PUN))"))
 
 (defn create-ns
   "Create an SCI namespace."
@@ -49,22 +60,31 @@
 (defn resolve
   "Resolve a symbol in the SCI context."
   [sym]
-  (sci/resolve @sci-ctx sym))
+  (sci/resolve (context) sym))
 
 (defn intern
   "Intern a value into an SCI namespace."
   [ns sym val]
-  (sci/intern @sci-ctx ns sym val))
+  (sci/intern (context) ns sym val))
 
 (defn set-underscore
-  "Set underscore in the current context."
+  "Set underscore in the current context. Within a run (see *fork*) _ is
+  bound to the run, so it is set! like a bound var; SCI's alter-var-root
+  would only change the root value that every run shares."
   [v]
-  (sci/alter-var-root _ (constantly v)))
+  (if *fork*
+    (sci/eval-form (context) (list 'set! 'clojure.core/_ (list 'quote v)))
+    (sci/alter-var-root _ (constantly v))))
 
 (defn update-environ
-  "Update environ in the current context."
+  "Update environ in the current context. Like _, ENV is bound to the run
+  within one (see set-underscore)."
   [m]
-  (sci/alter-var-root ENV (v0/make-environ-updater m)))
+  (if *fork*
+    (sci/eval-form (context)
+      (list 'set! 'clojure.core/ENV
+        (list 'quote ((v0/make-environ-updater m) @ENV))))
+    (sci/alter-var-root ENV (v0/make-environ-updater m))))
 
 ;; Route the stdlib's portable hooks at the SCI implementations
 (reset! v0/underscore-hook set-underscore)
@@ -82,7 +102,7 @@
 
 (def FILE (sci/new-dynamic-var 'FILE nil))
 
-(def error-msg-prefix (atom ()))
+(def ^:dynamic error-msg-prefix (atom ()))
 (defn reset-error-msg-prefix!
   "Reset error msg prefix! to its initial state."
   ([] (reset! error-msg-prefix "Error: "))
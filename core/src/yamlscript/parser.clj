@@ -11,7 +11,8 @@
   (:require
    [ys.v0.common])
   (:import
-   (java.util Optional)
+   (java.io BufferedReader Reader)
+   (java.util Iterator Optional)
    (org.snakeyaml.engine.v2.api LoadSettings)
    (org.snakeyaml.engine.v2.api.lowlevel Parse)
    (org.snakeyaml.engine.v2.exceptions Mark)
@@ -33,15 +34,53 @@
 
 (def shebang-ys #"^#!.*/env ys-0(?:\.\d+\.\d+)?\n")
 (def shebang-bash #"^#!.*[/ ]bash\n+source +<\(")
+
+(defn- reader-head
+  "Return the first 1024 chars of a reader's input (enough for the shebang
+  checks) and reset the reader to its start."
+  [^BufferedReader reader]
+  (let [size 1024
+        buf (char-array size)]
+    (.mark reader size)
+    (loop [n 0]
+      (let [got (if (< n size) (.read reader buf n (- size n)) -1)]
+        (if (pos? got)
+          (recur (+ n got))
+          (do
+            (.reset reader)
+            (String. buf 0 n)))))))
+
+(defn- event-seq
+  "Return a lazy seq of the events of a SnakeYAML event iterable. Unlike seq
+  on the iterable, events are pulled from the parser one at a time rather
+  than in chunks."
+  [^Iterable events]
+  (let [iter (.iterator events)
+        step (fn step [^Iterator iter]
+               (lazy-seq
+                 (when (.hasNext iter)
+                   (cons (.next iter) (step iter)))))]
+    (step iter)))
+
 (defn parse
-  "Parse a YAML string into a sequence of event objects."
-  [yaml-string]
+  "Parse YAML into a lazy sequence of event objects. The YAML can be a string
+  or a java.io.Reader. A reader is parsed as it is read, so a large input is
+  never turned into one big string, and events are only parsed as they are
+  consumed."
+  [yaml-input]
   (let [parser (new Parse (.build (LoadSettings/builder)))
+        reader (when (instance? Reader yaml-input)
+                 (if (instance? BufferedReader yaml-input)
+                   yaml-input
+                   (BufferedReader. yaml-input)))
+        head (if reader (reader-head reader) yaml-input)
         has-code-mode-shebang (or
-                                (re-find shebang-ys yaml-string)
-                                (re-find shebang-bash yaml-string))
-        events (->> yaml-string
-                 (.parseString parser)
+                                (re-find shebang-ys head)
+                                (re-find shebang-bash head))
+        events (->> (event-seq
+                      (if reader
+                        (.parseReader parser ^Reader reader)
+                        (.parseString parser ^String yaml-input)))
                  (map ys-event)
                  (remove nil?)
                  rest)
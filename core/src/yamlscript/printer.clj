@@ -8,7 +8,7 @@
   (:require
    [clojure.string :as str]
    [ys.v0.common]
-   [yamlscript.global])
+   [ys.v0.global])
   (:refer-clojure :exclude [print]))
 
 (def string-escape
@@ -53,67 +53,132 @@
           "Use '==' for equality comparison.")
     , s))
 
-(defn print-node
-  "Render one Clojure AST node into Clojure source text."
-  [node]
+(defn- string-char-escape
+  "Return the escape for a char of a string, or nil if it needs none."
+  [c]
+  (case c
+    \\ "\\\\"
+    \" "\\\""
+    \backspace "\\b"
+    \formfeed "\\f"
+    \newline "\\n"
+    \return "\\r"
+    \tab "\\t"
+    nil))
+
+(defn- regex-char-escape [c]
+  (when (= \" c) "\\\""))
+
+(defn- append-escaped
+  "Append s to sb, escaping its chars with char-escape. A string with nothing
+  to escape is appended as is."
+  ^StringBuilder [^StringBuilder sb ^String s char-escape]
+  (let [n (.length s)
+        i (loop [i 0]
+            (cond
+              (= i n) -1
+              (char-escape (.charAt s i)) i
+              :else (recur (inc i))))]
+    (if (neg? i)
+      (.append sb s)
+      (do
+        (.append sb s (int 0) (int i))
+        (loop [i i]
+          (when (< i n)
+            (let [c (.charAt s i)]
+              (if-let [escape (char-escape c)]
+                (.append sb ^String escape)
+                (.append sb c))
+              (recur (inc i))))))))
+  sb)
+
+(declare print-node!)
+
+(defn- print-all!
+  "Append the Clojure source of nodes to sb, separated by sep."
+  ^StringBuilder [^StringBuilder sb ^String sep nodes]
+  (loop [nodes (seq nodes), first? true]
+    (when nodes
+      (when-not first? (.append sb sep))
+      (print-node! sb (first nodes))
+      (recur (next nodes) false)))
+  sb)
+
+(defn- print-map!
+  "Append the key value pairs of a :Map node's val to sb."
+  ^StringBuilder [^StringBuilder sb pairs]
+  (loop [pairs (seq pairs), first? true]
+    (when (next pairs)
+      (when-not first? (.append sb ", "))
+      (print-node! sb (first pairs))
+      (.append sb " ")
+      (print-node! sb (second pairs))
+      (recur (nnext pairs) false)))
+  sb)
+
+(defn- print-node!
+  "Append the Clojure source text of one Clojure AST node to sb."
+  ^StringBuilder [^StringBuilder sb node]
   (let [node (if (keyword? node) {node true} node)
-        [type val] (first node)]
+        [type val] (first node)
+        text (fn [x] (.append sb (str x)))]
     (case type
-      nil  ""
-      :Lst (str
-             "("
-             (str/join " " (map print-node val))
-             ")")
-      :Vec (str
-             "["
-             (str/join " " (map print-node val))
-             "]")
-      :Set (str
-             "#{"
-             (str/join " " (map print-node val))
-             "}")
-      :Map (let [[start end] (if (:unordered @yamlscript.global/opts)
-                               ["{" "}"]
-                               ["(% " ")"])]
-             (str
-               start
-               (str/join ", " (->> val
-                                (partition 2)
-                                (map #(str
-                                        (print-node (first %1))
-                                        " "
-                                        (print-node (second %1))))))
-               end))
-      :Str (str \" (pr-string val) \")
-      :Rgx (str \# \" (pr-regex val) \")
-      :Chr (str "\\" val)
-      :QSym (str "'" val)
-      :Qts (str "'" val)
-      :Spc (str/replace val #"::" ".")
-      :Sym (pr-symbol (str val))
-      :Tok (str val)
-      :Tup (apply str (map print-node val))
-      :Key (str val)
-      :Int (str val)
-      :Flt (case (str val)
-             "Infinity" "##Inf"
-             "-Infinity" "##-Inf"
-             "NaN" "##NaN"
-             (str val))
-      :Num (pr-str val)
-      :Bln (str val)
-      :Clj (with-out-str (clojure.core/print val))
-      :Nil "nil"
+      nil  sb
+      :Lst (-> sb (.append "(") (print-all! " " val) (.append ")"))
+      :Vec (-> sb (.append "[") (print-all! " " val) (.append "]"))
+      :Set (-> sb (.append "#{") (print-all! " " val) (.append "}"))
+      :Map (if (:unordered @ys.v0.global/opts)
+             (-> sb (.append "{") (print-map! val) (.append "}"))
+             (-> sb (.append "(% ") (print-map! val) (.append ")")))
+      :Str (-> sb (.append \") (append-escaped val string-char-escape)
+             (.append \"))
+      :Rgx (-> sb (.append "#\"") (append-escaped val regex-char-escape)
+             (.append \"))
+      :Chr (-> sb (.append "\\") (.append (str val)))
+      :QSym (-> sb (.append "'") (.append (str val)))
+      :Qts (-> sb (.append "'") (.append (str val)))
+      :Spc (text (str/replace val #"::" "."))
+      :Sym (text (pr-symbol (str val)))
+      :Tok (text val)
+      :Tup (print-all! sb "" val)
+      :Key (text val)
+      :Int (text val)
+      :Flt (text (case (str val)
+                   "Infinity" "##Inf"
+                   "-Infinity" "##-Inf"
+                   "NaN" "##NaN"
+                   (str val)))
+      :Num (text (pr-str val))
+      :Bln (text val)
+      :Clj (text (with-out-str (clojure.core/print val)))
+      :Nil (text "nil")
       ,    (die "Unknown AST node type:" node))))
 
+(defn print-node
+  "Render one Clojure AST node into Clojure source text."
+  [node]
+  (str (print-node! (StringBuilder.) node)))
+
+;; Each thread renders into one StringBuilder, reused from print to print
+;; unless a very big document made it grow past this:
+(def ^:private max-reused-capacity (* 1024 1024))
+
+(def ^:private builder
+  (ThreadLocal/withInitial
+    (reify java.util.function.Supplier
+      (get [_] (StringBuilder.)))))
+
 (defn print
   "Render a YS AST as Clojure code."
   [node]
-  (let [list (or (:Top node) [node])
-        code (->> list
-               (map print-node)
-               (apply str))]
-    code))
+  (let [^StringBuilder sb (.get ^ThreadLocal builder)]
+    (.setLength sb 0)
+    (doseq [node (or (:Top node) [node])]
+      (print-node! sb node))
+    (let [code (str sb)]
+      (when (> (.capacity sb) max-reused-capacity)
+        (.set ^ThreadLocal builder (StringBuilder.)))
+      code)))
 
 (comment
   )
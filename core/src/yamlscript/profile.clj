@@ -0,0 +1,123 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+;; The yamlscript.profile library records where a run spends its time, for
+;; `ys --profile=json` and `YS_PROFILE=json` in libys.
+;;
+;; A profile has the wall time, the bytes allocated by the calling thread and
+;; the output size of every compiler stage of every YAML document, and the
+;; same for evaluating the compiled code. A run writes it as one JSON record.
+
+(ns yamlscript.profile
+  (:require
+   [clojure.data.json :as json])
+  (:import
+   (java.lang.management ManagementFactory))
+  (:refer-clojure))
+
+(def formats
+  "The supported profile output formats."
+  #{"json"})
+
+(def ^:dynamic *profile*
+  "An atom holding the profile being recorded, or nil when not profiling."
+  nil)
+
+(defn start
+  "Return a new profile atom to bind *profile* to."
+  []
+  (atom {:documents []
+         :eval nil
+         :start (System/nanoTime)}))
+
+(def ^:private thread-bean
+  "The ThreadMXBean that counts allocated bytes per thread, or nil where the
+  VM can't."
+  (delay
+    (try
+      (let [bean (ManagementFactory/getThreadMXBean)]
+        (when (and (instance? com.sun.management.ThreadMXBean bean)
+                (.isThreadAllocatedMemorySupported
+                  ^com.sun.management.ThreadMXBean bean))
+          (.setThreadAllocatedMemoryEnabled
+            ^com.sun.management.ThreadMXBean bean true)
+          bean))
+      (catch Throwable _ nil))))
+
+(defn- allocated-bytes []
+  (when-let [bean @thread-bean]
+    (.getThreadAllocatedBytes ^com.sun.management.ThreadMXBean bean
+      (.getId (Thread/currentThread)))))
+
+(def max-nodes
+  "The most nodes that node-count counts."
+  100000)
+
+(defn- realized-items
+  "Return the items of coll, stopping at the first part of a lazy seq that
+  isn't realized yet, so walking them never runs any lazy code."
+  [coll]
+  (lazy-seq
+    (when (or (not (instance? clojure.lang.IPending coll)) (realized? coll))
+      (when-let [s (seq coll)]
+        (cons (first s) (realized-items (rest s)))))))
+
+(defn node-count
+  "Return the size of a stage's output: the number of values in a tree of
+  maps and sequences, or the length of a string (like the printed code).
+  Only already realized values are counted, and counting stops at
+  max-nodes, so a huge or infinite eval result costs little to measure."
+  [x]
+  (if (string? x)
+    (count x)
+    (bounded-count max-nodes
+      (tree-seq coll? #(if (map? %1) (vals %1) (realized-items %1)) x))))
+
+(defn- millis [nanos]
+  (/ (Math/round (/ nanos 1000.0)) 1000.0))
+
+(defn document
+  "Start recording the stages of the next YAML document."
+  []
+  (when *profile*
+    (swap! *profile* update :documents conj {})))
+
+(defn measure
+  "Call f and return its value. While profiling, record f's wall time,
+  allocated bytes and output size (node-count of (size-of value)) as stage of
+  the current document, or of the whole run for the \"eval\" stage."
+  ([stage f]
+   (measure stage f identity))
+  ([stage f size-of]
+   (if-let [profile *profile*]
+     (let [bytes (allocated-bytes)
+           start (System/nanoTime)
+           value (f)
+           nanos (- (System/nanoTime) start)
+           stats {:ms (millis nanos)
+                  :bytes (when bytes (- (allocated-bytes) bytes))
+                  :nodes (node-count (size-of value))}]
+       (swap! profile
+         (fn [{:keys [documents] :as profile}]
+           (if (= "eval" stage)
+             (assoc profile :eval stats)
+             (assoc-in profile [:documents (dec (count documents)) stage]
+               stats))))
+       value)
+     (f))))
+
+(defn record
+  "Return the finished profile record for a profile atom's value."
+  [{:keys [start] :as profile}]
+  (-> profile
+    (dissoc :start)
+    (assoc :ms (millis (- (System/nanoTime) start)))))
+
+(defn json
+  "Return the finished profile record for a profile atom's value as one line
+  of JSON."
+  [profile]
+  (json/write-str (record profile)))
+
+(comment
+  )
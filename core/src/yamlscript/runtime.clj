@@ -31,7 +31,9 @@
    [ys.v0]
    [ys.v0.common :as common]
    [ys.v0.debug]
+   [ys.v0.global]
    [yamlscript.deps :as deps]
+   [yamlscript.emitter :as emitter]
    [yamlscript.global :as global]
    [ys.v0.manifest :as manifest]
    [ys.v0.re :as re]
@@ -251,6 +253,11 @@
 
       java.util.regex.Pattern]))
 
+;; The namespace and class tables above and the context below are built when
+;; this namespace loads. The native ys and libys builds initialize it at image
+;; build time (see NATIVE-OPTS in common/native.mk), so they live in the image
+;; heap and startup doesn't rebuild them. Keep anything that depends on the
+;; host or the environment (like RUN and ENV) out of them.
 (reset! global/sci-ctx
   (sci/init
     {:namespaces namespaces
@@ -306,6 +313,139 @@
               :yamlscript ys-version}
    :yspath (common/get-cmd-path)})
 
+;; The environment for ENV when it isn't this process's, like for a run that a
+;; client requested from `ys --server`:
+(def ^:dynamic *env* nil)
+
+;; RUN values that describe a run rather than this process (like the args and
+;; pid of a `ys --server` client), merged over the runtime info:
+(def ^:dynamic *run-info* nil)
+
+;; The runtime info and environment don't change while the process runs, so
+;; they are looked up (the hostname can take a DNS query) only for the first
+;; evaluation:
+(def ^:private runtime-info (delay (get-runtime-info)))
+(def ^:private environment (delay (into {} (System/getenv))))
+
+(defn with-run-state
+  "Call f with fresh per-run YS stream state: the document values (for
+  stream() and --stream), the anchors and the loaded pods. with-runtime does
+  this for each evaluation, unless its caller already has, like ys does to
+  read the stream values after a run. Runs in other threads (libys pools, ys
+  --server) each get their own."
+  [f]
+  (binding [ys.v0.global/stream-values (atom [])
+            ys.v0.global/stream-anchors_ (atom {})
+            ys.v0.global/doc-anchors_ (atom {})
+            global/pods (atom [])]
+    (f)))
+
+(defn with-runtime
+  "Call f with the YAMLScript runtime vars bound for a file and its command
+  line args. Callers that evaluate many code strings as one run pay for this
+  setup once. Agents are left running for later evaluations; the ys command
+  shuts them down when it exits.
+
+  f runs in a fresh fork of the SCI context (unless it is called from code
+  already running in one), with _ and the stream state (see with-run-state)
+  starting out empty, so nothing that one evaluation defines or stashes is
+  seen by the next."
+  [file args f]
+  (let [file (common/abspath (or file "NO-NAME"))
+        run (fn []
+              (binding [global/*fork* (or global/*fork*
+                                        (sci/fork @global/sci-ctx))]
+                (sci/binding
+                 [sci/out *out*
+                  sci/err *err*
+                  sci/in *in*
+                  sci/file file
+                  global/_ nil
+                  ARGS (vec
+                         (map #(cond
+                                 (re-matches re/xnum %1)
+                                 (read-string (str/replace %1 #"^([-+]?)0o"
+                                                (str "$1" "0")))
+                                 ,
+                                 (re-matches re/keyw %1)
+                                 (keyword (subs %1 1))
+                                 :else %1)
+                           args))
+                  ARGV args
+                  RUN (merge @runtime-info *run-info*)
+                  CWD (common/cwd)
+                  DIR (common/dirname file)
+                  global/ENV (or *env* @environment)
+                  global/FILE file
+                  INC (common/get-yspath file)]
+                  (let [val (f)]
+                    (ys/unload-pods)
+                    val))))]
+    (if (thread-bound? #'ys.v0.global/stream-values)
+      (run)
+      (with-run-state run))))
+
+(defn eval-clj
+  "Evaluate generated Clojure code in the YAMLScript SCI context, with the
+  runtime vars already bound by with-runtime."
+  [clj]
+  (let [clj (str/trim-newline clj)]
+    (if (= "" clj)
+      ""
+      (:val (sci/eval-string+
+              (global/context)
+              clj
+              {:ns global/main-ns})))))
+
+(defn read-clj
+  "Read generated Clojure code into a vector of forms, so that it can be
+  evaluated many times with eval-forms without being read again."
+  [clj]
+  (let [reader (sci/reader (str/trim-newline clj))]
+    (sci/binding [sci/ns global/main-ns]
+      (loop [forms []]
+        (let [form (sci/parse-next (global/context) reader)]
+          (if (= ::sci/eof form)
+            forms
+            (recur (conj forms form))))))))
+
+(defn- eval-code-text
+  "Read and evaluate the forms of a code text item from
+  compiler/compile-forms, in the current namespace. Return the value of the
+  last one, or val if there are none."
+  [val text]
+  (let [reader (sci/reader text)]
+    (loop [val val]
+      (let [form (sci/parse-next (global/context) reader)]
+        (if (= ::sci/eof form)
+          val
+          (recur (sci/eval-form (global/context) form)))))))
+
+;; A fn called with no args after each top-level form (like a YS document)
+;; that eval-forms evaluates, as `ys --stream` does to write the stream
+;; values while the program runs. Forms evaluated inside those forms (like
+;; the ones of a loaded file) don't call it:
+(def ^:dynamic *after-form* nil)
+
+(defn eval-forms
+  "Evaluate forms from read-clj or compiler/compile-forms like eval-clj
+  evaluates code, with the runtime vars already bound by with-runtime. Return
+  the value of the last form."
+  [forms]
+  (if (empty? forms)
+    ""
+    (let [after-form *after-form*]
+      (binding [*after-form* nil]
+        (sci/binding [sci/ns global/main-ns]
+          (reduce
+            (fn [val form]
+              (let [val (if (emitter/code? form)
+                          (eval-code-text val (:text form))
+                          (sci/eval-form (global/context) form))]
+                (when after-form (after-form))
+                val))
+            nil forms))))))
+
 (defn eval-string
   "Evaluate generated Clojure code in the YAMLScript SCI context."
   ([clj]
@@ -315,40 +455,28 @@
    (eval-string clj file []))
 
   ([clj file args]
-   (sci/alter-var-root sci/out (constantly *out*))
-   (sci/alter-var-root sci/err (constantly *err*))
-   (sci/alter-var-root sci/in (constantly *in*))
-
-   (let [clj (str/trim-newline clj)
-         file (common/abspath (or file "NO-NAME"))]
-     (if (= "" clj)
-       ""
-       (sci/binding
-        [sci/file file
-         ARGS (vec
-                (map #(cond
-                        (re-matches re/xnum %1)
-                        (read-string (str/replace %1 #"^([-+]?)0o"
-                                       (str "$1" "0")))
-                        ,
-                        (re-matches re/keyw %1)
-                        (keyword (subs %1 1))
-                        :else %1)
-                  args))
-         ARGV args
-         RUN (get-runtime-info)
-         CWD (str (ys.v0.fs/cwd))
-         DIR (common/dirname file)
-         global/ENV (into {} (System/getenv))
-         global/FILE file
-         INC (common/get-yspath file)]
-         (let [resp (sci/eval-string+
-                      @global/sci-ctx
-                      clj
-                      {:ns global/main-ns})]
-           (ys/unload-pods)
-           (shutdown-agents)
-           (:val resp)))))))
+   (if (= "" (str/trim-newline clj))
+     ""
+     (with-runtime file args #(eval-clj clj)))))
+
+(defn blank-forms?
+  "Return true when forms from compiler/compile-forms hold no code."
+  [forms]
+  (every? #(and (emitter/code? %1) (str/blank? (:text %1))) forms))
+
+(defn eval-code
+  "Evaluate the forms from compiler/compile-forms like eval-string evaluates
+  code."
+  ([forms]
+   (eval-code forms @sci/file))
+
+  ([forms file]
+   (eval-code forms file []))
+
+  ([forms file args]
+   (if (blank-forms? forms)
+     ""
+     (with-runtime file args #(eval-forms forms)))))
 
 (sci/intern @global/sci-ctx 'clojure.core 'eval-string eval-string)
 
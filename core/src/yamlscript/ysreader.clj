@@ -14,6 +14,8 @@
    [ys.v0.common]
    [yamlscript.global :as global]
    [yamlscript.re :as re])
+  (:import
+   (java.util.regex Matcher))
   (:refer-clojure :exclude [read-string]))
 
 (defn is-clojure-comment?
@@ -252,34 +254,135 @@
           (die "Unsupported dot special operation: " token))]
     (str/split expanded #" ")))
 
+(defn- re-lex-token
+  "Add a token to a transient token vector, expanding the tokens that stand
+  for several tokens (+++, colon calls and dot specials)."
+  [tokens token]
+  (cond
+    (= token "+++")
+    (-> tokens (conj! "(") (conj! "ys::std/stream") (conj! ")"))
+    ,
+    (is-colon-calls? token)
+    (reduce re-lex-token tokens (split-colon-calls token))
+    ,
+    (is-dot-special? token)
+    (reduce re-lex-token tokens (get-special-expansion token))
+    ,
+    :else
+    (conj! tokens token)))
+
 (defn re-lex-tokens
   "Reprocess lex tokens for YAMLScript parsing."
   [tokens]
-  (reduce (fn [acc token]
-            (cond
-              (= token "+++")
-              (vec (concat acc ["(" "ys::std/stream" ")"]))
-              ,
-              (is-colon-calls? token)
-              (vec (concat acc (re-lex-tokens (split-colon-calls token))))
-              ,
-              (is-dot-special? token)
-              (vec (concat acc (re-lex-tokens (get-special-expansion token))))
-              ,
-              :else
-              (conj acc token)))
-    []
-    tokens))
+  (persistent! (reduce re-lex-token (transient []) tokens)))
 
-(defn lex-tokens
-  "Lex tokens into YAMLScript tokens."
+(defn lex-tokens-regex
+  "Lex tokens into YAMLScript tokens with the re-tokenize regex alone. This is
+  the reference that lex-tokens must agree with."
   [expr]
-  (let [tokens (->> expr
-                 (re-seq re-tokenize)
-                 (remove #(re-matches re/ignr %1))
-                 re-lex-tokens)]
-    ;; XXX Might be too hot of a path to check here:
-    (if (System/getenv "YS_SHOW_LEX")
+  (->> expr
+    (re-seq re-tokenize)
+    (remove #(re-matches re/ignr %1))
+    re-lex-tokens))
+
+;; The lex-tokens scanner reads the most common tokens itself and hands
+;; everything else to re-tokenize. A scanned token must be exactly the token
+;; that the first matching re-tokenize alternative would produce.
+
+(defn- skip-char?
+  "Whitespace and commas, which re-tokenize matches one char at a time and
+  re/ignr then drops."
+  [c]
+  (case c
+    (\space \tab \newline \return \formfeed \u000B \,) true
+    false))
+
+(defn- line-break?
+  "Chars that a regex '.' does not match."
+  [c]
+  (case c
+    (\newline \return \u0085 \u2028 \u2029) true
+    false))
+
+(defn- word-char? [c]
+  (let [n (int c)]
+    (or (<= 97 n 122) (<= 65 n 90) (<= 48 n 57) (= 95 n) (= 45 n))))
+
+(defn- word-end
+  "Return the end of the run of [-a-zA-Z0-9_] chars at i, when it is a whole
+  token: a number (re/mnum) or a symbol (re/csym). A run followed by any
+  other char might be part of a longer token, so return nil."
+  [^String expr i]
+  (let [n (count expr)
+        j (loop [j (inc i)]
+            (if (and (< j n) (word-char? (.charAt expr j)))
+              (recur (inc j))
+              j))]
+    (when (or (= j n)
+            (case (.charAt expr j)
+              (\space \tab \newline \, \) \] \}) true
+              false))
+      j)))
+
+(defn- string-end
+  "Return the end of the double quoted string at i (re/dstr), or nil if it is
+  not closed or has a backslash before a line break."
+  [^String expr i]
+  (let [n (count expr)]
+    (loop [j (inc i)]
+      (when (< j n)
+        (let [c (.charAt expr j)]
+          (cond
+            (= \" c) (inc j)
+            (= \\ c) (when (and (< (inc j) n)
+                               (not (line-break? (.charAt expr (inc j)))))
+                        (recur (+ j 2)))
+            :else (recur (inc j))))))))
+
+(defn- token-end
+  "Return the end of the token at i if the scanner can read it, else nil."
+  [^String expr i]
+  (let [n (count expr)
+        c (.charAt expr i)]
+    (cond
+      (word-char? c) (word-end expr i)
+      (= \" c) (string-end expr i)
+      (case c (\( \[ \{) true false) (inc i)
+      ;; A closing bracket can start a colon call or a splat:
+      (case c (\) \] \}) true false)
+      (when (or (= (inc i) n)
+              (not (case (.charAt expr (inc i)) (\: \. \*) true false)))
+        (inc i)))))
+
+(def ^:private show-lex
+  (delay (System/getenv "YS_SHOW_LEX")))
+
+(defn lex-tokens
+  "Lex tokens into YAMLScript tokens, in a single pass over expr. Words,
+  numbers, brackets and strings are scanned directly and anything else is
+  matched with re-tokenize at the same position. The tokens are the same as
+  from lex-tokens-regex."
+  [^String expr]
+  (let [n (count expr)
+        ^Matcher matcher (re-matcher re-tokenize expr)
+        tokens (loop [i 0, tokens (transient [])]
+                 (if (< i n)
+                   (if (skip-char? (.charAt expr i))
+                     (recur (inc i) tokens)
+                     (if-let [end (token-end expr i)]
+                       (recur end (conj! tokens (subs expr i end)))
+                       ;; find can skip chars that no alternative matches
+                       ;; (like \u2028) and land on a whitespace token, which
+                       ;; lex-tokens-regex drops with re/ignr too:
+                       (if (.find matcher (int i))
+                         (let [token (.group matcher)]
+                           (recur (long (.end matcher))
+                             (if (re-matches re/ignr token)
+                               tokens
+                               (re-lex-token tokens token))))
+                         (persistent! tokens))))
+                   (persistent! tokens)))]
+    (if @show-lex
       (WWW tokens)
       tokens)))
 
@@ -5,7 +5,8 @@
   (:require
    [babashka.fs :as fs]
    [clojure.java.io :as io]
-   [clojure.string :as str])
+   [clojure.string :as str]
+   [ys.v0.common :as common])
   (:refer-clojure :exclude [abs empty? find]))
 
 (def this 'ys.v0.fs)
@@ -74,7 +75,7 @@
 (intern this 'abs (multi #(-> %1 fs/absolutize str)))
 (intern this 'basename (multi #(-> %1 fs/canonicalize fs/file-name str)))
 (intern this 'ctime (multi #(fs/file-time->millis (fs/last-modified-time %1))))
-(intern this 'cwd #(str (fs/cwd)))
+(intern this 'cwd #(str (common/cwd)))
 (intern this 'dirname (multi #(-> %1 fs/canonicalize fs/parent str)))
 (intern this 'filename
   (fn
@@ -8,10 +8,16 @@
 
 (ns ys.v0.global)
 
-(def stream-anchors_ (atom {}))
-(def doc-anchors_ (atom {}))
-(def stream-values (atom []))
-(def opts (atom {}))
+;; The state that evaluating a YS stream builds up: anchored values and the
+;; value of each document. These are dynamic so that a runtime can give each
+;; run its own (see yamlscript.runtime/with-run-state).
+(def ^:dynamic stream-anchors_ (atom {}))
+(def ^:dynamic doc-anchors_ (atom {}))
+(def ^:dynamic stream-values (atom []))
+
+;; The options of the current run (like the ys command line options). Bound
+;; per run where several runs share a process, like `ys --server`.
+(def ^:dynamic opts (atom {}))
 
 ;; Runtime variables. Under the ys runtime these are shadowed by SCI dynamic
 ;; vars of the same names; under plain Clojure runtimes ys.v0/init binds them.
@@ -27,21 +33,27 @@
 (def ^:dynamic RUN {})
 (def ^:dynamic VERSION nil)
 
-(def env {})
+;; The environment, as a map. Like opts, it is bound per run where runs share
+;; a process.
+(def ^:dynamic env {})
+
+(defn- set-env [m]
+  (if (thread-bound? #'env)
+    (set! env m)
+    (alter-var-root #'env (constantly m))))
 
 (defn update-env
   "Update env in the current context."
   [m]
-  (let [m (reduce-kv
-            (fn [m k v] (if v (assoc m k v) (dissoc m k)))
-            env m)]
-    (alter-var-root #'env (constantly m))))
+  (set-env
+    (reduce-kv
+      (fn [m k v] (if v (assoc m k v) (dissoc m k)))
+      env m)))
 
 (defn reset-env
   "Reset env to its initial state."
   [m]
-  (let [m (or m (into {} (System/getenv)))]
-    (alter-var-root #'env (constantly m))))
+  (set-env (or m (into {} (System/getenv)))))
 
 (defn- default-set-underscore [v]
   (alter-var-root #'_ (constantly v)))
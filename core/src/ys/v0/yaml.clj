@@ -30,19 +30,70 @@
 (def prefix-re
   #"^(?:(?:[ \t]*#.*\n)|(?:\s*\n))*---\s+")
 
+(def ^:private load-options
+  [:code-point-limit (* 10 1024 1024)
+   :keywords false])
+
 (defn load [str]
-  (parse-string str
-    :code-point-limit (* 10 1024 1024)
-    :keywords false))
+  (apply parse-string str load-options))
 
-(defn load-all [str]
+(defn- split-all
+  "Load every document by splitting the text on --- lines, for clj-yaml.core
+  implementations without :load-all."
+  [str]
   (let [str (str/replace str prefix-re "")
         documents (str/split str #"(?m)^---\s+")]
-    (reduce
-      (fn [data doc]
-        (conj data (load doc)))
-      []
-      documents)))
+    (map load documents)))
+
+(defn- parse-all
+  "Return a lazy seq of the documents that SnakeYAML's loadAll yields from
+  source (a string for parse-string, a Reader for parse-stream). The code
+  point limit applies to each document, not to the whole stream."
+  [parse source]
+  (let [f (util/backend parse)]
+    (seq (apply f source :load-all true load-options))))
+
+;; Whether the clj-yaml.core backend supports :load-all, found out once on
+;; first use. Without it the option is ignored or refused, so a two document
+;; stream doesn't load as two documents:
+(def ^:private load-all?
+  (delay
+    (util/catching
+      (= [1 2] (vec (parse-all 'clj-yaml.core/parse-string "1\n---\n2\n")))
+      false)))
+
+(defn load-all
+  "Load every YAML document in a string into a vector. Empty input (or only
+  comments) gives [nil], like loading an empty document. Use load-stream to
+  parse the documents one at a time as they are consumed."
+  [str]
+  (let [docs (vec
+               (if @load-all?
+                 (parse-all 'clj-yaml.core/parse-string str)
+                 (split-all str)))]
+    (if (empty? docs) [nil] docs)))
+
+(defn- close-at-end
+  "Return docs, closing reader once they have all been consumed."
+  [^java.io.Closeable reader docs]
+  (lazy-seq
+    (if-let [docs (seq docs)]
+      (cons (first docs) (close-at-end reader (rest docs)))
+      (.close reader))))
+
+(defn load-stream
+  "Load every YAML document in a file (a path or java.io.File) or a
+  java.io.Reader, without reading it all into memory. The documents are
+  parsed one at a time as the returned seq is consumed, so a long stream of
+  documents (like a YAML log) can be processed in constant memory when the
+  seq's head isn't held. A file is closed after its last document; a reader
+  is left to its owner."
+  [source]
+  (if (instance? java.io.Reader source)
+    (parse-all 'clj-yaml.core/parse-stream source)
+    (let [reader ((util/backend 'clojure.java.io/reader) source)]
+      (close-at-end reader
+        (parse-all 'clj-yaml.core/parse-stream reader)))))
 
 (defn dump [data]
   (generate-string
@@ -11,6 +11,7 @@
    [yamlscript.externals :as externals]
    [yamlscript.global :as global]
    [yamlscript.re :as re]
+   [ys.v0.global]
    [ys.v0.util :as util]
    [ys.v0.ys])
   (:refer-clojure
@@ -63,17 +64,17 @@
 (defn eval
   ([ys-code] (ys.ys/eval ys-code "EVAL" false))
   ([ys-code file stream-mode]
-   (let [stream @global/stream-values
-         _ (reset! global/stream-values [])
+   (let [stream @ys.v0.global/stream-values
+         _ (reset! ys.v0.global/stream-values [])
          clj-code (ys.ys/compile ys-code)
          value (sci/binding
                 [sci/file file
                  global/FILE file]
-                 (sci/eval-string+ @global/sci-ctx clj-code))
+                 (sci/eval-string+ (global/context) clj-code))
          value (if stream-mode
-                 @global/stream-values
+                 @ys.v0.global/stream-values
                  (:val value))
-         _ (reset! global/stream-values stream)]
+         _ (reset! ys.v0.global/stream-values stream)]
      value)))
 
 (defn eval-stream [ys-code]
@@ -4,8 +4,13 @@
 (ns yamlscript.compiler-test
   (:require
    [clojure.string :as str]
+   [clojure.test :refer [deftest is]]
+   [ys.v0]
    [ys.v0.common]
+   [ys.v0.global]
+   [yamlscript.cache :as cache]
    [yamlscript.compiler :as compiler]
+   [yamlscript.profile :as profile]
    [yamltest.core :as test]))
 
 (defn testing-fix-clojure [clj]
@@ -41,3 +46,56 @@
              (catch Exception e
                (:cause (Throwable->map e)))))
    :want :error})
+
+(deftest caches-compiled-code
+  (let [source "!ys-0:\nsay: 6 * 7\n"
+        _ (compiler/compile source)
+        hits (:hits @cache/compile-stats)
+        clj (compiler/compile source)]
+    (is (= (inc hits) (:hits @cache/compile-stats)))
+    (is (= (compiler/compile-uncached source) clj))
+    (swap! ys.v0.global/opts assoc :unordered true)
+    (try
+      (compiler/compile source)
+      (is (= (inc hits) (:hits @cache/compile-stats)))
+      (finally
+        (swap! ys.v0.global/opts dissoc :unordered)))))
+
+(deftest compile-key-has-the-ys-version
+  (let [key (#'compiler/compile-key "a: 1\n")]
+    (is (seq ys.v0/VERSION))
+    (is (str/starts-with? key (str ys.v0/VERSION " ")))))
+
+(deftest compiles-big-streams-in-document-order
+  (let [source (apply str "!ys-0\n"
+                 (for [i (range 12)]
+                   (str "--- !ys\n=>::\n  n:: " i " + 1\n")))
+        in-turn (with-bindings {#'compiler/*compile-task* true}
+                  (compiler/compile-uncached source))]
+    (is (= in-turn (compiler/compile-uncached source)))
+    (is (str/includes? in-turn "(add+ 11 1)"))))
+
+(deftest compiles-a-stream-a-document-at-a-time
+  (let [source "!ys-0\n--- !ys\n=>: 6 * 7\n--- !ys\n=>: [1, 2\n"
+        blocks (with-bindings {#'compiler/*compile-task* true}
+                 (compiler/compile-stream source))]
+    (is (str/includes? (second blocks) "(mul+ 6 7)"))
+    (is (thrown? Exception (doall blocks)))))
+
+(deftest profiles-every-stage-of-every-document
+  (let [source "!ys-0\n--- !ys\n=>: 6 * 7\n--- !ys\n=>: 2 + 3\n"]
+    (binding [profile/*profile* (profile/start)]
+      (is (= (compiler/compile-uncached source) (compiler/compile source)))
+      (let [{:keys [documents]} (profile/record @profile/*profile*)]
+        (is (= 3 (count documents)))
+        (is (= ["parse" "compose" "resolve" "build" "transform" "construct"
+                "print"]
+              (keys (second documents))))
+        (is (every? #(number? (:ms %1)) (vals (second documents))))))))
+
+(deftest node-count-only-counts-realized-values
+  (is (= 5 (profile/node-count [1 [2 3]])))
+  (is (= profile/max-nodes (profile/node-count (range 1000000))))
+  (let [s (map inc [1 2 3])]
+    (is (= 1 (profile/node-count s)))
+    (is (not (realized? s)))))
@@ -4,6 +4,7 @@
 (ns yamlscript.parser-test
   (:require
    [clojure.string :as str]
+   [clojure.test :refer [deftest is]]
    [ys.v0.common]
    [yamlscript.parser :as parser]
    [yamltest.core :as test]))
@@ -23,3 +24,12 @@
            (-> test
              :parse
              str/split-lines))})
+
+(deftest parses-from-a-reader
+  (doseq [yaml ["- foo: bar\n- [1, 2]\n"
+                "a: 1\nb:\n  c: [x, y]\n"
+                "#!/usr/bin/env ys-0\nsay: 42\n"
+                (str "#!/usr/bin/env ys-0\n# "
+                  (apply str (repeat 2000 "x")) "\nsay: 42\n")]]
+    (is (= (parser/parse yaml)
+          (parser/parse (java.io.StringReader. yaml))))))
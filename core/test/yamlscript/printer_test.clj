@@ -3,6 +3,7 @@
 
 (ns yamlscript.printer-test
   (:require
+   [clojure.test :refer [deftest is]]
    [yamlscript.builder :as builder]
    [ys.v0.common]
    [yamlscript.compiler :as compiler]
@@ -32,3 +33,11 @@
              printer/print
              compiler/pretty-format))
    :want :print})
+
+(deftest prints-strings-with-and-without-escapes
+  (doseq [s ["plain" "" "a \"quoted\" word" "tab\there\nnewline\\"
+             (apply str (repeat 1000 "x"))]]
+    (is (= (str \" (printer/pr-string s) \")
+          (printer/print {:Str s}))))
+  (is (= "(f \"a\\nb\" #\"\\d\\\"\")"
+        (printer/print {:Lst [{:Sym 'f} {:Str "a\nb"} {:Rgx "\\d\""}]}))))
@@ -4,8 +4,10 @@
 (ns yamlscript.runtime-test
   (:require
    [clojure.edn :as edn]
+   [clojure.test :refer [deftest is]]
    [yamlscript.compiler :as compiler]
    [yamlscript.runtime :as runtime]
+   [ys.v0.global]
    [yamltest.core :as test]))
 
 (test/load-yaml-test-files
@@ -21,3 +23,47 @@
            (-> test
              :eval
              edn/read-string))})
+
+(deftest evals-read-forms-many-times
+  (let [forms (-> "!ys-0\nmapv inc: ARGS\n"
+                compiler/compile
+                runtime/read-clj)
+        eval-with (fn [args]
+                    (runtime/with-runtime nil args
+                      #(runtime/eval-forms forms)))]
+    (is (= [2 3] (eval-with ["1" "2"])))
+    (is (= [11] (eval-with ["10"])))
+    (is (= "" (runtime/eval-forms (runtime/read-clj ""))))))
+
+(deftest evals-emitted-forms-like-code
+  (doseq [{:keys [ys eval]} (test/read-tests "test/runtime.yaml"
+                              #(test/has-keys? [:ys :eval] %1))]
+    (is (= (edn/read-string eval)
+          (-> (str "!ys-0\n" ys)
+            compiler/compile-forms
+            runtime/eval-code))
+      ys)))
+
+(deftest stack-trace-errors-have-locations
+  (let [error-data #(binding [ys.v0.global/opts (atom {:stack-trace true})]
+                      (try
+                        (-> "!ys-0\n=>: 1\n=>: inc(nil)\n"
+                          compiler/compile-forms
+                          runtime/eval-code)
+                        (catch Exception e (ex-data e))))]
+    (is (integer? (:line (error-data))))
+    (is (integer? (:column (error-data))))))
+
+(deftest evals-in-a-fresh-fork-each-time
+  (let [eval-ys #(-> (str "!ys-0\n" %1)
+                   compiler/compile
+                   runtime/eval-string)]
+    (is (= 42 (eval-ys "defn answer(): 42\n=>: answer()")))
+    (is (thrown? Exception (eval-ys "=>: answer()")))))
+
+(deftest starts-each-run-with-empty-stream-state
+  (is (= [[42] 42 1]
+        (runtime/eval-string "(_& 'a 1) (+++ 42) [(stream) _ (_** 'a)]")))
+  (is (= [[] nil :none]
+        (runtime/eval-string
+          "[(stream) _ (try (_** 'a) (catch Exception e :none))]"))))
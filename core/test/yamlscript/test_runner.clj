@@ -4,7 +4,7 @@
 (ns yamlscript.test-runner
   (:require
    [yamltest.core :as test]
-   [yamlscript.global :as global]
+   [ys.v0.global :as global]
    [yamlscript.builder-test]
    [yamlscript.compiler-test]
    [yamlscript.composer-test]
@@ -12,7 +12,8 @@
    [yamlscript.parser-test]
    [yamlscript.printer-test]
    [yamlscript.resolver-test]
-   [yamlscript.transformer-test]))
+   [yamlscript.transformer-test]
+   [yamlscript.ysreader-test]))
 
 (swap! global/opts assoc :unordered true)
 
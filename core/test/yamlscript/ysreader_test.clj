@@ -0,0 +1,53 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+(ns yamlscript.ysreader-test
+  (:require
+   [clojure.string :as str]
+   [clojure.test :refer [deftest is]]
+   [ys.v0.common]
+   [yamlscript.parser :as parser]
+   [yamlscript.ysreader :as ysreader]
+   [yamltest.core :as test]))
+
+(defn- lexed [lex expr]
+  (try
+    (lex expr)
+    (catch Exception e
+      (.getMessage e))))
+
+(defn- exprs
+  "Every line and every YAML string value of a test's YS source."
+  [source]
+  (concat
+    (str/split-lines source)
+    (try
+      (->> source
+        parser/parse
+        (mapcat #(filter string? (vals %1))))
+      (catch Exception _ []))))
+
+;; The lex-tokens scanner must lex exactly like the re-tokenize regex:
+(test/load-yaml-test-files
+  ["test/compiler.yaml"
+   "test/compiler-stack.yaml"
+   "test/data-mode.yaml"
+   "test/literals.yaml"
+   "test/resolver.yaml"
+   "test/transformer.yaml"]
+  {:pick #(test/has-keys? [:yamlscript] %1)
+   :test (fn [test]
+           (->> test
+             :yamlscript
+             exprs
+             (remove #(= (lexed ysreader/lex-tokens-regex %1)
+                        (lexed ysreader/lex-tokens %1)))
+             vec))
+   :want (constantly [])})
+
+;; The fixtures never have the chars that a regex '.' does not match:
+(deftest lexes-like-the-regex-around-line-break-chars
+  (doseq [expr ["a\u2028 b" "a\u0085 b" "a\u2029\tb" "f(\u2028 1, 2)"]]
+    (is (= (lexed ysreader/lex-tokens-regex expr)
+          (lexed ysreader/lex-tokens expr))
+      (pr-str expr))))
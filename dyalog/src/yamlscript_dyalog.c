@@ -1,21 +1,37 @@
-#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define YS_VERSION "0.2.31"
+#include "libys_ffi.h"
 
-typedef int (*graal_create_isolate_fn)(void *, void *, void *);
-typedef int (*graal_tear_down_isolate_fn)(void *);
-typedef char *(*load_ys_to_json_fn)(void *, char *);
+#define YS_VERSION "0.2.31"
 
-static void *libys = NULL;
-static void *isolate_thread = NULL;
-static graal_tear_down_isolate_fn tear_down_isolate = NULL;
-static load_ys_to_json_fn load_ys = NULL;
+// Finding libys and the isolate are handled by the shared libys-ffi
+// helper library (libys_ffi.c). All calls share one long-lived isolate;
+// each OS thread that calls in (like a thread started for a ⎕NA call
+// made from a future) attaches to it once and keeps its attachment, so
+// threads can evaluate in parallel without starting an isolate each.
+
+// The APL result buffer. Responses that fit are written straight into
+// it; bigger ones go to spill memory so they can be truncated:
+struct output {
+  char *buffer;
+  int max;
+  char *spill;
+};
+
+static char *alloc_output(void *ctx, size_t size) {
+  struct output *out = ctx;
+  if (out->max > 0 && size < (size_t)out->max) {
+    return out->buffer;
+  }
+  out->spill = malloc(size);
+  return out->spill;
+}
 
-static int copy_output(char *output, int max, const char *text) {
-  int len = (int)strlen(text);
+static int copy_output(char *output, int max, const char *text, int len) {
   if (max <= 0) {
     return -len;
   }
@@ -24,91 +40,149 @@ static int copy_output(char *output, int max, const char *text) {
     output[max - 1] = '\0';
     return -len;
   }
-  memcpy(output, text, (size_t)len + 1);
+  memcpy(output, text, (size_t)len);
+  output[len] = '\0';
   return len;
 }
 
-static int copy_error(char *output, int max, const char *message) {
-  char buffer[4096];
-  snprintf(
-    buffer,
-    sizeof(buffer),
-    "{\"error\":{\"cause\":\"%s\"}}",
-    message
-  );
-  return copy_output(output, max, buffer);
-}
+// Compile and eval a YS string into a caller buffer of max bytes. A
+// response that does not fit is truncated and its length returned
+// negated, so the caller would have to evaluate again with a bigger
+// buffer. The handle API below (ys_load) avoids that:
+int ys_load_json(const char *input, char *output, int max) {
+  ys_ffi_open(YS_VERSION, getenv("YAMLSCRIPT_DYALOG_LIBYS"));
 
-static int open_libys(char *output, int max) {
-  if (load_ys != NULL) {
-    return 0;
+  struct output out = { output, max, NULL };
+  size_t len = 0;
+  char *json = ys_ffi_load_json(
+    ys_ffi_shared_pool(), input, alloc_output, &out, &len);
+  if (json == NULL) {
+    const char *error =
+      "{\"error\":{\"cause\":\"failed to allocate output buffer\"}}";
+    return copy_output(output, max, error, (int)strlen(error));
   }
 
-  const char *names[] = {
-    "libys.so." YS_VERSION,
-    "libys.so",
-    NULL,
-  };
-
-  const char *env = getenv("YAMLSCRIPT_DYALOG_LIBYS");
-  if (env != NULL) {
-    libys = dlopen(env, RTLD_LAZY);
+  if (json == output) {
+    output[len] = '\0';
+    return (int)len;
   }
 
-  for (int i = 0; names[i] != NULL; i++) {
-    if (libys != NULL) {
-      break;
-    }
-    libys = dlopen(names[i], RTLD_LAZY);
-    if (libys != NULL) {
-      break;
+  int rc = copy_output(output, max, json, (int)len);
+  free(out.spill);
+  return rc;
+}
+
+// Results kept for the handle API below. A result id is its slot
+// index plus 1, so that 0 is never a valid id:
+struct result {
+  char *json;
+  int len;
+};
+
+static struct result *results = NULL;
+static int results_size = 0;
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Keep json in a free slot and return its id, or -1:
+static int keep_result(char *json, int len) {
+  int id = -1;
+  int i;
+
+  pthread_mutex_lock(&results_lock);
+  for (i = 0; i < results_size && results[i].json != NULL; i++) {}
+  if (i == results_size) {
+    int size = results_size > 0 ? results_size * 2 : 8;
+    struct result *grown = realloc(results, size * sizeof(*results));
+    if (grown != NULL) {
+      memset(grown + results_size, 0,
+        (size - results_size) * sizeof(*results));
+      results = grown;
+      results_size = size;
     }
   }
-
-  if (libys == NULL) {
-    return copy_error(output, max, dlerror());
+  if (i < results_size) {
+    results[i].json = json;
+    results[i].len = len;
+    id = i + 1;
   }
+  pthread_mutex_unlock(&results_lock);
 
-  graal_create_isolate_fn create_isolate =
-    (graal_create_isolate_fn)dlsym(libys, "graal_create_isolate");
-  tear_down_isolate =
-    (graal_tear_down_isolate_fn)dlsym(libys, "graal_tear_down_isolate");
-  load_ys = (load_ys_to_json_fn)dlsym(libys, "load_ys_to_json");
-
-  if (
-    create_isolate == NULL ||
-    tear_down_isolate == NULL ||
-    load_ys == NULL
-  ) {
-    return copy_error(output, max, "required libys symbol not found");
+  return id;
+}
+
+// Return the result slot for id, or NULL. Call with the lock held:
+static struct result *find_result(int id) {
+  if (id < 1 || id > results_size || results[id - 1].json == NULL) {
+    return NULL;
   }
+  return &results[id - 1];
+}
 
-  if (create_isolate(NULL, NULL, &isolate_thread) != 0) {
-    return copy_error(output, max, "failed to create GraalVM isolate");
+// Compile and eval a YS string once and keep the JSON response. Returns
+// a result id and sets *len to the response byte length, so the caller
+// can size a buffer for ys_result exactly. Returns -1 if no memory is
+// left. Every id must be given back with ys_free:
+int ys_load(const char *input, int *len) {
+  size_t size = 0;
+  char *json;
+  int id;
+
+  ys_ffi_open(YS_VERSION, getenv("YAMLSCRIPT_DYALOG_LIBYS"));
+
+  json = ys_ffi_load_json(ys_ffi_shared_pool(), input, NULL, NULL, &size);
+  if (json == NULL || size > INT_MAX) {
+    free(json);
+    return -1;
   }
 
-  return 0;
+  id = keep_result(json, (int)size);
+  if (id < 0) {
+    free(json);
+    return -1;
+  }
+  *len = (int)size;
+  return id;
 }
 
-int ys_load_json(const char *input, char *output, int max) {
-  int rc = open_libys(output, max);
-  if (rc != 0) {
-    return rc;
+// Copy the response for id into output, NUL terminated. max must be
+// more than its length. Returns the length, or -1 for an unknown id or
+// a buffer that is too small:
+int ys_result(int id, char *output, int max) {
+  struct result *result;
+  int len = -1;
+
+  pthread_mutex_lock(&results_lock);
+  result = find_result(id);
+  if (result != NULL && result->len < max) {
+    len = result->len;
+    memcpy(output, result->json, (size_t)len);
+    output[len] = '\0';
   }
+  pthread_mutex_unlock(&results_lock);
 
-  char *json = load_ys(isolate_thread, (char *)input);
-  if (json == NULL) {
-    return copy_error(output, max, "null response from libys");
+  return len;
+}
+
+// Free the response for id. Returns 0, or -1 for an unknown id:
+int ys_free(int id) {
+  struct result *result;
+  char *json = NULL;
+
+  pthread_mutex_lock(&results_lock);
+  result = find_result(id);
+  if (result != NULL) {
+    json = result->json;
+    result->json = NULL;
   }
+  pthread_mutex_unlock(&results_lock);
 
-  return copy_output(output, max, json);
+  free(json);
+  return json != NULL ? 0 : -1;
 }
 
+// Detach the calling thread from the isolate. Its next call attaches
+// again:
 int ys_close(void) {
-  if (tear_down_isolate == NULL || isolate_thread == NULL) {
-    return 0;
-  }
-  int rc = tear_down_isolate(isolate_thread);
-  isolate_thread = NULL;
-  return rc;
+  ys_ffi_pool_release(ys_ffi_shared_pool());
+  return 0;
 }
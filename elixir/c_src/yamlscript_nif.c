@@ -4,122 +4,30 @@
 // Erlang NIF shim for the Elixir yamlscript binding.
 //
 // The BEAM cannot call arbitrary C functions directly, so this small
-// NIF dlopens the libys shared library and exposes its
-// load_ys_to_json function as a dirty-CPU NIF. The library search
-// paths and exact version pinning are ported from the Python
-// reference implementation.
+// NIF exposes the libys load_ys_to_json function as a dirty-CPU NIF.
+// Finding and opening libys, the isolate pool and the result buffers
+// are handled by the shared libys-ffi helper library (libys_ffi.c).
 //
-// A GraalVM isolate is created and torn down per call (the same
-// pattern as the Java and R bindings), which keeps the NIF safe to
-// call from any BEAM scheduler thread.
+// Creating a GraalVM isolate costs far more than compiling and
+// evaluating a small document, so the NIF keeps a private pool of
+// long-lived isolates, one per dirty CPU scheduler. The pool is
+// created in the load callback, handed over on code upgrade and torn
+// down in the unload callback.
 
-#include <dlfcn.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <erl_nif.h>
 
+#include "libys_ffi.h"
+#include "libys_ffi_nif.h"
+
 // This value is automatically updated by 'make bump'.
 // We currently only support binding to an exact version of libys:
 #define YAMLSCRIPT_VERSION "0.2.31"
 
-#ifdef __APPLE__
-#define LIBYS_NAME "libys.dylib." YAMLSCRIPT_VERSION
-#else
-#define LIBYS_NAME "libys.so." YAMLSCRIPT_VERSION
-#endif
-
-typedef int (*create_isolate_fn)(void *, void **, void **);
-typedef int (*tear_down_isolate_fn)(void *);
-typedef char *(*load_ys_to_json_fn)(void *, const char *);
-
-static void *libys = NULL;
-static create_isolate_fn create_isolate;
-static tear_down_isolate_fn tear_down_isolate;
-static load_ys_to_json_fn load_ys_to_json;
-static char load_error[512] = "";
-
-// Return 1 if the libys file exists in dir and fills path:
-static int check_dir(const char *dir, char *path, size_t size) {
-  FILE *file;
-
-  snprintf(path, size, "%s/%s", dir, LIBYS_NAME);
-  file = fopen(path, "r");
-  if (file == NULL) return 0;
-  fclose(file);
-  return 1;
-}
-
-// Find the libys shared library file path.
-// Search LD_LIBRARY_PATH entries, then common install locations:
-static int find_libys(char *path, size_t size) {
-  const char *library_path = getenv("LD_LIBRARY_PATH");
-  const char *home;
-
-  if (library_path != NULL) {
-    char *paths = strdup(library_path);
-    char *dir = strtok(paths, ":");
-    while (dir != NULL) {
-      if (check_dir(dir, path, size)) {
-        free(paths);
-        return 1;
-      }
-      dir = strtok(NULL, ":");
-    }
-    free(paths);
-  }
-
-  if (check_dir("/usr/local/lib", path, size)) return 1;
-
-  home = getenv("HOME");
-  if (home != NULL) {
-    char dir[4096];
-    snprintf(dir, sizeof(dir), "%s/.local/lib", home);
-    if (check_dir(dir, path, size)) return 1;
-  }
-
-  return 0;
-}
-
-// Open libys and resolve the 3 symbols used by this binding.
-// On failure, load_error is set and libys stays NULL:
-static void open_libys(void) {
-  char path[4096];
-
-  if (!find_libys(path, sizeof(path))) {
-    snprintf(load_error, sizeof(load_error),
-      "Shared library file '%s' not found\n"
-      "Try: curl https://yamlscript.org/install |"
-      " VERSION=%s LIB=1 bash\n"
-      "See: https://github.com/yaml/yamlscript/wiki/"
-      "Installing-YAMLScript",
-      LIBYS_NAME, YAMLSCRIPT_VERSION);
-    return;
-  }
-
-  libys = dlopen(path, RTLD_NOW);
-  if (libys == NULL) {
-    snprintf(load_error, sizeof(load_error),
-      "Failed to load shared library '%s'", path);
-    return;
-  }
-
-  create_isolate =
-    (create_isolate_fn)dlsym(libys, "graal_create_isolate");
-  tear_down_isolate =
-    (tear_down_isolate_fn)dlsym(libys, "graal_tear_down_isolate");
-  load_ys_to_json =
-    (load_ys_to_json_fn)dlsym(libys, "load_ys_to_json");
-
-  if (create_isolate == NULL || tear_down_isolate == NULL ||
-      load_ys_to_json == NULL) {
-    snprintf(load_error, sizeof(load_error),
-      "Required symbols not found in libys");
-    dlclose(libys);
-    libys = NULL;
-  }
-}
+// CBOR null becomes this atom:
+#define NULL_ATOM "nil"
 
 // Build an {:error, binary} tuple:
 static ERL_NIF_TERM error_tuple(ErlNifEnv *env, const char *message) {
@@ -133,69 +41,239 @@ static ERL_NIF_TERM error_tuple(ErlNifEnv *env, const char *message) {
     enif_make_binary(env, &bin));
 }
 
+// Let libys-ffi write results straight into a BEAM binary:
+static char *alloc_binary(void *ctx, size_t size) {
+  ErlNifBinary *bin = ctx;
+
+  if (!enif_alloc_binary(size, bin)) return NULL;
+  return (char *)bin->data;
+}
+
+// Compile and eval a YAMLScript string, returning the libys response
+// as a map built straight from its CBOR encoding, with no JSON text
+// step, or {:error, binary} if it can not be decoded:
+static ERL_NIF_TERM load_ys_to_term_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input;
+  ERL_NIF_TERM term;
+  char *cbor;
+  size_t len;
+  int ok;
+
+  if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
+    return enif_make_badarg(env);
+  }
+
+  cbor = ys_ffi_load_cbor(enif_priv_data(env),
+    (const char *)input.data, input.size, NULL, NULL, &len);
+  if (cbor == NULL) return error_tuple(env, "Out of memory");
+
+  ok = ys_ffi_nif_decode(env, cbor, len, NULL_ATOM, &term);
+  free(cbor);
+
+  if (!ok) return error_tuple(env, "Invalid CBOR response from 'libys'");
+  return term;
+}
+
 // Compile and eval a YAMLScript string, returning the raw JSON
-// response as a binary, or {:error, binary} if libys is unusable:
+// response as a binary, or {:error, binary} if no memory is left.
+// libys reads the input binary in place:
 static ERL_NIF_TERM load_ys_to_json_nif(
   ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
 ) {
   ErlNifBinary input, output;
-  char *input_z;
-  const char *json;
-  void *isolate = NULL;
-  void *thread = NULL;
-  size_t len;
 
   if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
     return enif_make_badarg(env);
   }
 
-  if (libys == NULL) {
-    return error_tuple(env, load_error);
+  if (ys_ffi_load_buffer_json(enif_priv_data(env),
+        (const char *)input.data, input.size,
+        alloc_binary, &output, NULL) == NULL) {
+    return error_tuple(env, "Out of memory");
+  }
+
+  return enif_make_binary(env, &output);
+}
+
+// Compile and eval a list of YAMLScript strings in one libys call,
+// returning a JSON array binary with one response per input:
+static ERL_NIF_TERM load_ys_batch_to_json_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input, output;
+  ERL_NIF_TERM list, head;
+  unsigned count;
+  long long *lengths;
+  const char **inputs;
+  char *json = NULL;
+  unsigned n = 0;
+
+  if (argc != 1 || !enif_get_list_length(env, argv[0], &count)) {
+    return enif_make_badarg(env);
   }
 
-  // Null-terminate the input binary:
-  input_z = enif_alloc(input.size + 1);
-  memcpy(input_z, input.data, input.size);
-  input_z[input.size] = '\0';
+  // One block for the lengths and then the input pointers:
+  lengths = enif_alloc((count + 1) * (sizeof(long long) + sizeof(char *)));
+  if (lengths == NULL) return error_tuple(env, "Out of memory");
+  inputs = (const char **)(lengths + count + 1);
+
+  // libys reads each input binary in place:
+  list = argv[0];
+  while (n < count && enif_get_list_cell(env, list, &head, &list) &&
+         enif_inspect_binary(env, head, &input)) {
+    inputs[n] = (const char *)input.data;
+    lengths[n++] = (long long)input.size;
+  }
 
-  if (create_isolate(NULL, &isolate, &thread) != 0) {
-    enif_free(input_z);
-    return error_tuple(env, "Failed to create isolate");
+  if (n == count) {
+    json = ys_ffi_load_batch_json(enif_priv_data(env),
+      inputs, lengths, (int)count, alloc_binary, &output, NULL);
   }
+  enif_free(lengths);
+
+  if (n != count) return enif_make_badarg(env);
+  if (json == NULL) return error_tuple(env, "Out of memory");
+
+  return enif_make_binary(env, &output);
+}
 
-  json = load_ys_to_json(thread, input_z);
-  enif_free(input_z);
+//------------------------------------------------------------------------------
+// Compiled programs
+//------------------------------------------------------------------------------
 
-  if (json == NULL) {
-    tear_down_isolate(thread);
-    return error_tuple(env, "Null response from 'libys'");
+// A compiled program is a resource, released when it is garbage
+// collected:
+static ErlNifResourceType *program_type = NULL;
+
+struct program {
+  ys_ffi_program *program;
+};
+
+static void program_dtor(ErlNifEnv *env, void *obj) {
+  (void)env;
+  ys_ffi_release(((struct program *)obj)->program);
+}
+
+static int open_program_type(ErlNifEnv *env, ErlNifResourceFlags flags) {
+  program_type = enif_open_resource_type(
+    env, NULL, "program", program_dtor, flags, NULL);
+  return program_type != NULL ? 0 : -1;
+}
+
+// Compile a YAMLScript string once for any number of evals. Returns a
+// program resource, or {:error, binary} if no memory is left:
+static ERL_NIF_TERM compile_ys_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input;
+  struct program *res;
+  ys_ffi_program *program;
+  ERL_NIF_TERM term;
+
+  if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
+    return enif_make_badarg(env);
   }
 
-  len = strlen(json);
-  enif_alloc_binary(len, &output);
-  memcpy(output.data, json, len);
+  program = ys_ffi_compile(enif_priv_data(env),
+    (const char *)input.data, input.size);
+  if (program == NULL) return error_tuple(env, "Out of memory");
 
-  if (tear_down_isolate(thread) != 0) {
-    enif_release_binary(&output);
-    return error_tuple(env, "Failed to tear down isolate");
+  res = enif_alloc_resource(program_type, sizeof(struct program));
+  if (res == NULL) {
+    ys_ffi_release(program);
+    return error_tuple(env, "Out of memory");
   }
+  res->program = program;
+  term = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return term;
+}
 
+// Eval a compiled program with a JSON options binary (args and env),
+// returning the raw JSON response as a binary:
+static ERL_NIF_TERM eval_ys_to_json_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  struct program *res;
+  ErlNifBinary opts, output;
+  char *copy;
+  char *json;
+
+  if (argc != 2 ||
+      !enif_get_resource(env, argv[0], program_type, (void **)&res) ||
+      !enif_inspect_binary(env, argv[1], &opts)) {
+    return enif_make_badarg(env);
+  }
+
+  copy = enif_alloc(opts.size + 1);
+  if (copy == NULL) return error_tuple(env, "Out of memory");
+  memcpy(copy, opts.data, opts.size);
+  copy[opts.size] = '\0';
+
+  json = ys_ffi_eval_json(res->program, copy, alloc_binary, &output, NULL);
+  enif_free(copy);
+
+  if (json == NULL) return error_tuple(env, "Out of memory");
   return enif_make_binary(env, &output);
 }
 
+// The load info is the number of dirty CPU schedulers, which is the
+// most threads that can ever call into the NIF at once:
+static int pool_size(ErlNifEnv *env, ERL_NIF_TERM load_info) {
+  ErlNifSysInfo info;
+  int size;
+
+  if (enif_get_int(env, load_info, &size) && size > 0) return size;
+  enif_system_info(&info, sizeof(info));
+  return info.scheduler_threads > 0 ? info.scheduler_threads : 1;
+}
+
+// A missing libys is not a load failure; every call then returns the
+// reason as an error response:
 static int load(
   ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info
 ) {
-  (void)env;
-  (void)priv_data;
-  (void)load_info;
-  open_libys();
+  if (open_program_type(env, ERL_NIF_RT_CREATE) != 0) return -1;
+  ys_ffi_open(YAMLSCRIPT_VERSION, NULL);
+  *priv_data = ys_ffi_pool_create(pool_size(env, load_info));
   return 0;
 }
 
+// Hand the running pool over to the new module instance, so warm
+// isolates survive a hot code upgrade. The old instance's unload
+// then has nothing left to tear down:
+static int upgrade(
+  ErlNifEnv *env, void **priv_data, void **old_priv_data,
+  ERL_NIF_TERM load_info
+) {
+  ys_ffi_pool *pool = ys_ffi_pool_adopt(*old_priv_data);
+
+  if (pool == NULL) return load(env, priv_data, load_info);
+  // Live programs belong to the adopted pool, so take them over too:
+  if (open_program_type(env, ERL_NIF_RT_TAKEOVER) != 0) return -1;
+  ys_ffi_open(YAMLSCRIPT_VERSION, NULL);
+  *priv_data = pool;
+  *old_priv_data = NULL;
+  return 0;
+}
+
+static void unload(ErlNifEnv *env, void *priv_data) {
+  (void)env;
+  ys_ffi_pool_destroy(priv_data);
+}
+
 static ErlNifFunc nif_funcs[] = {
+  {"nif_load_ys_to_term", 1, load_ys_to_term_nif,
+   ERL_NIF_DIRTY_JOB_CPU_BOUND},
   {"nif_load_ys_to_json", 1, load_ys_to_json_nif,
    ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_compile_ys", 1, compile_ys_nif, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_eval_ys_to_json", 2, eval_ys_to_json_nif,
+   ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_load_ys_batch_to_json", 1, load_ys_batch_to_json_nif,
+   ERL_NIF_DIRTY_JOB_CPU_BOUND},
 };
 
-ERL_NIF_INIT(Elixir.YAMLScript, nif_funcs, load, NULL, NULL, NULL)
+ERL_NIF_INIT(Elixir.YAMLScript, nif_funcs, load, NULL, upgrade, unload)
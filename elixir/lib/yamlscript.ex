@@ -19,7 +19,8 @@ defmodule YAMLScript do
   @doc false
   def load_nif do
     path = :filename.join(:code.priv_dir(:yamlscript), ~c"yamlscript_nif")
-    :erlang.load_nif(path, 0)
+    # The NIF keeps one libys isolate per dirty CPU scheduler:
+    :erlang.load_nif(path, :erlang.system_info(:dirty_cpu_schedulers))
   end
 
   @doc """
@@ -27,24 +28,83 @@ defmodule YAMLScript do
   """
   @spec load(String.t()) :: {:ok, term()} | {:error, String.t()}
   def load(input) when is_binary(input) do
-    case nif_load_ys_to_json(input) do
+    # The NIF builds the response map directly from libys' CBOR
+    # encoding, so no JSON text is produced or parsed:
+    case nif_load_ys_to_term(input) do
+      {:error, message} -> {:error, message}
+      resp when is_map(resp) -> response(resp)
+    end
+  end
+
+  @doc """
+  Compile and eval a list of YAMLScript strings in a single libys call.
+
+  Returns a list with an `{:ok, data}` or `{:error, message}` result for
+  each input, in input order, or `{:error, message}` if libys could not
+  be called at all. Loading many small documents this way is much
+  faster than calling `load/1` for each one.
+  """
+  @spec load_batch([String.t()]) ::
+          [{:ok, term()} | {:error, String.t()}] | {:error, String.t()}
+  def load_batch(inputs) when is_list(inputs) do
+    case nif_load_ys_batch_to_json(inputs) do
       {:error, message} ->
         {:error, message}
 
       json when is_binary(json) ->
-        # Decode the JSON response and check for a libys error:
-        resp = JSON.decode!(json)
+        case JSON.decode!(json) do
+          resps when is_list(resps) -> Enum.map(resps, &response/1)
+          resp -> response(resp)
+        end
+    end
+  end
 
-        cond do
-          err = resp["error"] ->
-            {:error, err["cause"]}
+  @doc """
+  Compile a YAMLScript string once, to be evaluated any number of times
+  with `eval/2`.
 
-          Map.has_key?(resp, "data") ->
-            {:ok, resp["data"]}
+  Evaluating a compiled program skips parsing and compiling it, which is
+  most of the work for small documents. A compile error is returned by
+  each `eval/2` of the program. The program is freed when it is garbage
+  collected.
+  """
+  @spec compile(String.t()) :: reference() | {:error, String.t()}
+  def compile(input) when is_binary(input) do
+    nif_compile_ys(input)
+  end
 
-          true ->
-            {:error, "Unexpected response from 'libys'"}
-        end
+  @doc """
+  Evaluate a program from `compile/1`.
+
+  Options:
+
+    * `:args` - a list of strings, the `ARGS` of this evaluation
+    * `:env` - a map of strings, merged over the process `ENV`
+  """
+  @spec eval(reference(), keyword()) :: {:ok, term()} | {:error, String.t()}
+  def eval(program, opts \\ []) do
+    opts = opts |> Map.new() |> Map.take([:args, :env]) |> JSON.encode!()
+
+    case nif_eval_ys_to_json(program, opts) do
+      {:error, message} ->
+        {:error, message}
+
+      json when is_binary(json) ->
+        json |> JSON.decode!() |> response()
+    end
+  end
+
+  # Check a decoded libys response for an error:
+  defp response(resp) do
+    cond do
+      err = resp["error"] ->
+        {:error, err["cause"]}
+
+      Map.has_key?(resp, "data") ->
+        {:ok, resp["data"]}
+
+      true ->
+        {:error, "Unexpected response from 'libys'"}
     end
   end
 
@@ -60,7 +120,19 @@ defmodule YAMLScript do
     end
   end
 
-  defp nif_load_ys_to_json(_input) do
+  defp nif_load_ys_to_term(_input) do
+    :erlang.nif_error(:nif_not_loaded)
+  end
+
+  defp nif_compile_ys(_input) do
+    :erlang.nif_error(:nif_not_loaded)
+  end
+
+  defp nif_eval_ys_to_json(_program, _opts) do
+    :erlang.nif_error(:nif_not_loaded)
+  end
+
+  defp nif_load_ys_batch_to_json(_inputs) do
     :erlang.nif_error(:nif_not_loaded)
   end
 end
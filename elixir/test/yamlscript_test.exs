@@ -30,4 +30,88 @@ defmodule YAMLScriptTest do
                YAMLScript.load("!ys-0:\ntest:: inc(41)")
     end
   end
+
+  test "each load starts with an empty stream" do
+    # The pool keeps its isolates between loads; none of an earlier load's
+    # document values should be left in stream().
+    for n <- 1..50 do
+      assert {:ok, %{"values" => [^n]}} =
+               YAMLScript.load("""
+               !ys-0
+               ---
+               =>: #{n}
+               ---
+               !data
+               values:: stream()
+               """)
+    end
+  end
+
+  test "load native types" do
+    assert {:ok, data} =
+             YAMLScript.load("""
+             int: 1180591620717411303424
+             neg: -3
+             float: 1.5
+             null: null
+             bool: true
+             list: [1, [2, 3], {a: 4}]
+             """)
+
+    assert %{
+             "int" => 1_180_591_620_717_411_303_424,
+             "neg" => -3,
+             "float" => 1.5,
+             "null" => nil,
+             "bool" => true,
+             "list" => [1, [2, 3], %{"a" => 4}]
+           } = data
+  end
+
+  test "load batch" do
+    inputs = ["!ys-0:\ntest:: inc(41)", ":", "foo: bar"]
+
+    assert [{:ok, %{"test" => 42}}, {:error, cause}, {:ok, foo}] =
+             YAMLScript.load_batch(inputs)
+
+    assert is_binary(cause)
+    assert %{"foo" => "bar"} = foo
+    assert [] = YAMLScript.load_batch([])
+  end
+
+  test "each batch item gets its own runtime" do
+    inputs = ["!ys-0:\nx =: 41\ntest:: inc(x)", "!ys-0:\ntest:: inc(x)"]
+
+    assert [{:ok, %{"test" => 42}}, {:error, _}] =
+             YAMLScript.load_batch(inputs)
+  end
+
+  test "compile once, eval many times" do
+    program = YAMLScript.compile("!ys-0:\ntest:: ARGS.0 + 1")
+
+    assert {:ok, %{"test" => 42}} = YAMLScript.eval(program, args: ["41"])
+    assert {:ok, %{"test" => 2}} = YAMLScript.eval(program, args: ["1"])
+
+    env = YAMLScript.compile("!ys-0:\nname:: ENV.WHO")
+    assert {:ok, %{"name" => "ys"}} =
+             YAMLScript.eval(env, env: %{"WHO" => "ys"})
+
+    assert {:error, cause} = YAMLScript.eval(YAMLScript.compile(":"))
+    assert is_binary(cause)
+  end
+
+  test "load concurrently" do
+    results =
+      1..16
+      |> Task.async_stream(fn n ->
+        {n, YAMLScript.load("!ys-0:\ntest:: inc(#{n})")}
+      end)
+      |> Enum.to_list()
+
+    assert length(results) == 16
+
+    for {:ok, {n, result}} <- results do
+      assert result == {:ok, %{"test" => n + 1}}
+    end
+  end
 end
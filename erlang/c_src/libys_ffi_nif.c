@@ -0,0 +1,205 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// See libys_ffi_nif.h for what this library is for.
+
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libys_ffi_nif.h"
+
+// Deeper data than this is refused rather than risk the C stack:
+#define MAX_DEPTH 512
+
+struct decoder {
+  ErlNifEnv *env;
+  const unsigned char *p;
+  const unsigned char *end;
+  const char *null_atom;
+};
+
+static int decode_term(struct decoder *d, int depth, ERL_NIF_TERM *term);
+
+// Make an integer term from a big endian magnitude. A negative number
+// is -1 - magnitude (as CBOR stores it). The BEAM has no C API for big
+// integers, so this goes through the external term format:
+static int make_bignum(
+  ErlNifEnv *env, const unsigned char *bytes, size_t size, int negative,
+  ERL_NIF_TERM *term
+) {
+  unsigned char *etf = enif_alloc(size + 8);
+  size_t i, n = 0;
+  int carry = negative;
+  int ok;
+
+  if (etf == NULL) return 0;
+
+  // Little endian digits, adding the 1 for negative numbers:
+  for (i = 0; i < size; i++) {
+    int digit = bytes[size - 1 - i] + carry;
+    carry = digit > 0xff;
+    etf[7 + i] = digit & 0xff;
+  }
+  etf[7 + size] = carry;
+  n = size + carry;
+
+  etf[0] = 131;
+  etf[1] = 111;
+  etf[2] = (n >> 24) & 0xff;
+  etf[3] = (n >> 16) & 0xff;
+  etf[4] = (n >> 8) & 0xff;
+  etf[5] = n & 0xff;
+  etf[6] = negative;
+
+  ok = enif_binary_to_term(env, etf, n + 7, term, 0) != 0;
+  enif_free(etf);
+  return ok;
+}
+
+static int decode_array(
+  struct decoder *d, int depth, unsigned long long count, ERL_NIF_TERM *term
+) {
+  ERL_NIF_TERM *items;
+  unsigned long long i;
+
+  // Every item takes at least one byte:
+  if (count > (unsigned long long)(d->end - d->p)) return 0;
+  if (count == 0) {
+    *term = enif_make_list(d->env, 0);
+    return 1;
+  }
+
+  items = enif_alloc(count * sizeof(ERL_NIF_TERM));
+  if (items == NULL) return 0;
+  for (i = 0; i < count; i++) {
+    if (!decode_term(d, depth + 1, &items[i])) {
+      enif_free(items);
+      return 0;
+    }
+  }
+  *term = enif_make_list_from_array(d->env, items, (unsigned)count);
+  enif_free(items);
+  return 1;
+}
+
+// A repeated key keeps its last value, like a JSON decoder:
+static int decode_map(
+  struct decoder *d, int depth, unsigned long long count, ERL_NIF_TERM *term
+) {
+  ERL_NIF_TERM map = enif_make_new_map(d->env);
+  ERL_NIF_TERM key, value;
+  unsigned long long i;
+
+  if (count > (unsigned long long)(d->end - d->p)) return 0;
+  for (i = 0; i < count; i++) {
+    if (!decode_term(d, depth + 1, &key) ||
+        !decode_term(d, depth + 1, &value) ||
+        !enif_make_map_put(d->env, map, key, value, &map)) {
+      return 0;
+    }
+  }
+  *term = map;
+  return 1;
+}
+
+static int decode_simple(
+  struct decoder *d, int info, unsigned long long arg, ERL_NIF_TERM *term
+) {
+  ErlNifEnv *env = d->env;
+  double f;
+
+  switch (info) {
+  case 20: *term = enif_make_atom(env, "false"); return 1;
+  case 21: *term = enif_make_atom(env, "true"); return 1;
+  case 22:
+  case 23: *term = enif_make_atom(env, d->null_atom); return 1;
+  case 25:
+  case 26:
+  case 27:
+    f = ys_ffi_cbor_float(info, arg);
+    // BEAM floats can not be NaN or infinite:
+    if (f != f) {
+      *term = enif_make_atom(env, "nan");
+    } else if (f > DBL_MAX) {
+      *term = enif_make_atom(env, "infinity");
+    } else if (f < -DBL_MAX) {
+      *term = enif_make_atom(env, "neg_infinity");
+    } else {
+      *term = enif_make_double(env, f);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+static int decode_term(struct decoder *d, int depth, ERL_NIF_TERM *term) {
+  int major, info;
+  unsigned long long arg;
+  unsigned char *data;
+
+  if (depth > MAX_DEPTH) return 0;
+  if (ys_ffi_cbor_head(&d->p, d->end, &major, &info, &arg) != 0) return 0;
+
+  switch (major) {
+  case 0:
+    *term = enif_make_uint64(d->env, (ErlNifUInt64)arg);
+    return 1;
+
+  case 1:
+    if (arg <= INT64_MAX) {
+      *term = enif_make_int64(d->env, -1 - (ErlNifSInt64)arg);
+      return 1;
+    } else {
+      unsigned char bytes[8];
+      int i;
+      for (i = 0; i < 8; i++) bytes[i] = (arg >> (56 - 8 * i)) & 0xff;
+      return make_bignum(d->env, bytes, 8, 1, term);
+    }
+
+  // Byte and text strings both become binaries:
+  case 2:
+  case 3:
+    if (arg > (unsigned long long)(d->end - d->p)) return 0;
+    data = enif_make_new_binary(d->env, (size_t)arg, term);
+    memcpy(data, d->p, (size_t)arg);
+    d->p += arg;
+    return 1;
+
+  case 4:
+    return decode_array(d, depth, arg, term);
+
+  case 5:
+    return decode_map(d, depth, arg, term);
+
+  // Tags 2 and 3 are bignums; other tags are ignored:
+  case 6:
+    if (arg == 2 || arg == 3) {
+      unsigned long long size;
+      if (ys_ffi_cbor_head(&d->p, d->end, &major, &info, &size) != 0 ||
+          major != 2 || size > (unsigned long long)(d->end - d->p)) {
+        return 0;
+      }
+      d->p += size;
+      return make_bignum(
+        d->env, d->p - size, (size_t)size, arg == 3, term);
+    }
+    return decode_term(d, depth + 1, term);
+
+  default:
+    return decode_simple(d, info, arg, term);
+  }
+}
+
+int ys_ffi_nif_decode(
+  ErlNifEnv *env, const char *cbor, size_t len, const char *null_atom,
+  ERL_NIF_TERM *term
+) {
+  struct decoder d;
+
+  d.env = env;
+  d.p = (const unsigned char *)cbor;
+  d.end = d.p + len;
+  d.null_atom = null_atom;
+  return decode_term(&d, 0, term) && d.p == d.end;
+}
@@ -0,0 +1,28 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// libys-ffi-nif builds BEAM terms from libys CBOR responses, for the
+// NIF shims of the elixir and erlang bindings. It is built next to
+// libys_ffi.c, whose CBOR readers it uses.
+//
+// Like libys_ffi.c, the sources live in common/libys-ffi/ and
+// common/binding.mk copies them into each binding that uses them. Edit
+// the common/ copy only.
+
+#ifndef LIBYS_FFI_NIF_H
+#define LIBYS_FFI_NIF_H
+
+#include <erl_nif.h>
+
+#include "libys_ffi.h"
+
+// Decode the len bytes of CBOR at cbor into *term. Maps become maps,
+// arrays lists, strings binaries and big integers integers. CBOR null
+// becomes the null_atom atom ("nil" for Elixir, "null" for Erlang).
+// Returns 1, or 0 if the data is invalid, too deep or has trailing
+// bytes:
+YS_FFI_API int ys_ffi_nif_decode(
+  ErlNifEnv *env, const char *cbor, size_t len, const char *null_atom,
+  ERL_NIF_TERM *term);
+
+#endif
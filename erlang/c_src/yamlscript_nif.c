@@ -1,170 +1,253 @@
 // Copyright 2023-2026 Ingy dot Net
 // This code is licensed under MIT license (See License for details)
 
-#include <dlfcn.h>
-#include <stdio.h>
+// A thin adapter over the shared libys-ffi helper library, which owns
+// finding libys, the isolate pool and the result buffers.
+
 #include <stdlib.h>
 #include <string.h>
 
 #include <erl_nif.h>
 
+#include "libys_ffi.h"
+#include "libys_ffi_nif.h"
+
 #ifndef YAMLSCRIPT_VERSION
 #define YAMLSCRIPT_VERSION "0.0.0"
 #endif
 
-#ifdef __APPLE__
-#define LIBYS_NAME "libys.dylib." YAMLSCRIPT_VERSION
-#else
-#define LIBYS_NAME "libys.so." YAMLSCRIPT_VERSION
-#endif
+// CBOR null becomes this atom:
+#define NULL_ATOM "null"
 
-typedef int (*create_isolate_fn)(void *, void **, void **);
-typedef int (*tear_down_isolate_fn)(void *);
-typedef char *(*load_ys_to_json_fn)(void *, const char *);
+static ERL_NIF_TERM error_tuple(ErlNifEnv *env, const char *message) {
+  ErlNifBinary bin;
+  size_t len = strlen(message);
 
-static void *libys = NULL;
-static create_isolate_fn create_isolate;
-static tear_down_isolate_fn tear_down_isolate;
-static load_ys_to_json_fn load_ys_to_json;
-static char load_error[512] = "";
+  enif_alloc_binary(len, &bin);
+  memcpy(bin.data, message, len);
+  return enif_make_tuple2(env,
+    enif_make_atom(env, "error"),
+    enif_make_binary(env, &bin));
+}
 
-static int check_dir(const char *dir, char *path, size_t size) {
-  FILE *file;
+static char *alloc_binary(void *ctx, size_t size) {
+  ErlNifBinary *bin = ctx;
 
-  snprintf(path, size, "%s/%s", dir, LIBYS_NAME);
-  file = fopen(path, "r");
-  if (file == NULL) return 0;
-  fclose(file);
-  return 1;
+  if (!enif_alloc_binary(size, bin)) return NULL;
+  return (char *)bin->data;
 }
 
-static int find_libys(char *path, size_t size) {
-  const char *library_path = getenv("LD_LIBRARY_PATH");
-  const char *home;
-
-  if (library_path != NULL) {
-    char *paths = strdup(library_path);
-    char *dir = strtok(paths, ":");
-    while (dir != NULL) {
-      if (check_dir(dir, path, size)) {
-        free(paths);
-        return 1;
-      }
-      dir = strtok(NULL, ":");
-    }
-    free(paths);
+// Compile and eval a YAMLScript string, returning the libys response
+// as a map built straight from its CBOR encoding, with no JSON text
+// step, or {error, Binary} if it can not be decoded:
+static ERL_NIF_TERM load_term_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input;
+  ERL_NIF_TERM term;
+  char *cbor;
+  size_t len;
+  int ok;
+
+  if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
+    return enif_make_badarg(env);
   }
 
-  if (check_dir("/usr/local/lib", path, size)) return 1;
+  cbor = ys_ffi_load_cbor(enif_priv_data(env),
+    (const char *)input.data, input.size, NULL, NULL, &len);
+  if (cbor == NULL) return error_tuple(env, "Out of memory");
 
-  home = getenv("HOME");
-  if (home != NULL) {
-    char dir[4096];
-    snprintf(dir, sizeof(dir), "%s/.local/lib", home);
-    if (check_dir(dir, path, size)) return 1;
-  }
+  ok = ys_ffi_nif_decode(env, cbor, len, NULL_ATOM, &term);
+  free(cbor);
 
-  return 0;
+  if (!ok) return error_tuple(env, "Invalid CBOR response from 'libys'");
+  return term;
 }
 
-static void open_libys(void) {
-  char path[4096];
+// libys reads the input binary in place:
+static ERL_NIF_TERM load_json_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input, output;
 
-  if (!find_libys(path, sizeof(path))) {
-    snprintf(load_error, sizeof(load_error),
-      "Shared library file '%s' not found", LIBYS_NAME);
-    return;
+  if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
+    return enif_make_badarg(env);
   }
 
-  libys = dlopen(path, RTLD_NOW);
-  if (libys == NULL) {
-    snprintf(load_error, sizeof(load_error),
-      "Failed to load shared library");
-    return;
+  if (ys_ffi_load_buffer_json(enif_priv_data(env),
+        (const char *)input.data, input.size,
+        alloc_binary, &output, NULL) == NULL) {
+    return error_tuple(env, "Out of memory");
   }
 
-  create_isolate =
-    (create_isolate_fn)dlsym(libys, "graal_create_isolate");
-  tear_down_isolate =
-    (tear_down_isolate_fn)dlsym(libys, "graal_tear_down_isolate");
-  load_ys_to_json =
-    (load_ys_to_json_fn)dlsym(libys, "load_ys_to_json");
-
-  if (create_isolate == NULL || tear_down_isolate == NULL ||
-      load_ys_to_json == NULL) {
-    snprintf(load_error, sizeof(load_error),
-      "Required symbols not found in libys");
-    dlclose(libys);
-    libys = NULL;
+  return enif_make_binary(env, &output);
+}
+
+static ERL_NIF_TERM load_batch_json_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  ErlNifBinary input, output;
+  ERL_NIF_TERM list, head;
+  unsigned count;
+  long long *lengths;
+  const char **inputs;
+  char *json = NULL;
+  unsigned n = 0;
+
+  if (argc != 1 || !enif_get_list_length(env, argv[0], &count)) {
+    return enif_make_badarg(env);
   }
+
+  // One block for the lengths and then the input pointers:
+  lengths = enif_alloc((count + 1) * (sizeof(long long) + sizeof(char *)));
+  if (lengths == NULL) return error_tuple(env, "Out of memory");
+  inputs = (const char **)(lengths + count + 1);
+
+  // libys reads each input binary in place:
+  list = argv[0];
+  while (n < count && enif_get_list_cell(env, list, &head, &list) &&
+         enif_inspect_binary(env, head, &input)) {
+    inputs[n] = (const char *)input.data;
+    lengths[n++] = (long long)input.size;
+  }
+
+  if (n == count) {
+    json = ys_ffi_load_batch_json(enif_priv_data(env),
+      inputs, lengths, (int)count, alloc_binary, &output, NULL);
+  }
+  enif_free(lengths);
+
+  if (n != count) return enif_make_badarg(env);
+  if (json == NULL) return error_tuple(env, "Out of memory");
+
+  return enif_make_binary(env, &output);
 }
 
-static ERL_NIF_TERM error_tuple(ErlNifEnv *env, const char *message) {
-  ErlNifBinary bin;
-  size_t len = strlen(message);
+//------------------------------------------------------------------------------
+// Compiled programs
+//------------------------------------------------------------------------------
 
-  enif_alloc_binary(len, &bin);
-  memcpy(bin.data, message, len);
-  return enif_make_tuple2(env,
-    enif_make_atom(env, "error"),
-    enif_make_binary(env, &bin));
+// A compiled program is a resource, released when it is garbage
+// collected:
+static ErlNifResourceType *program_type = NULL;
+
+struct program {
+  ys_ffi_program *program;
+};
+
+static void program_dtor(ErlNifEnv *env, void *obj) {
+  (void)env;
+  ys_ffi_release(((struct program *)obj)->program);
 }
 
-static ERL_NIF_TERM load_json_nif(
+static int open_program_type(ErlNifEnv *env, ErlNifResourceFlags flags) {
+  program_type = enif_open_resource_type(
+    env, NULL, "program", program_dtor, flags, NULL);
+  return program_type != NULL ? 0 : -1;
+}
+
+// Compile a YAMLScript string once for any number of evals. Returns a
+// program resource, or {error, Binary} if no memory is left:
+static ERL_NIF_TERM compile_nif(
   ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
 ) {
-  ErlNifBinary input, output;
-  char *input_z;
-  const char *json;
-  void *isolate = NULL;
-  void *thread = NULL;
-  size_t len;
+  ErlNifBinary input;
+  struct program *res;
+  ys_ffi_program *program;
+  ERL_NIF_TERM term;
 
   if (argc != 1 || !enif_inspect_binary(env, argv[0], &input)) {
     return enif_make_badarg(env);
   }
 
-  if (libys == NULL) return error_tuple(env, load_error);
+  program = ys_ffi_compile(enif_priv_data(env),
+    (const char *)input.data, input.size);
+  if (program == NULL) return error_tuple(env, "Out of memory");
 
-  input_z = enif_alloc(input.size + 1);
-  memcpy(input_z, input.data, input.size);
-  input_z[input.size] = '\0';
-
-  if (create_isolate(NULL, &isolate, &thread) != 0) {
-    enif_free(input_z);
-    return error_tuple(env, "Failed to create isolate");
+  res = enif_alloc_resource(program_type, sizeof(struct program));
+  if (res == NULL) {
+    ys_ffi_release(program);
+    return error_tuple(env, "Out of memory");
   }
+  res->program = program;
+  term = enif_make_resource(env, res);
+  enif_release_resource(res);
+  return term;
+}
 
-  json = load_ys_to_json(thread, input_z);
-  enif_free(input_z);
-
-  if (json == NULL) {
-    tear_down_isolate(thread);
-    return error_tuple(env, "Null response from libys");
+// Eval a compiled program with a JSON options binary (args and env),
+// returning the raw JSON response as a binary:
+static ERL_NIF_TERM eval_json_nif(
+  ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[]
+) {
+  struct program *res;
+  ErlNifBinary opts, output;
+  char *copy;
+  char *json;
+
+  if (argc != 2 ||
+      !enif_get_resource(env, argv[0], program_type, (void **)&res) ||
+      !enif_inspect_binary(env, argv[1], &opts)) {
+    return enif_make_badarg(env);
   }
 
-  len = strlen(json);
-  enif_alloc_binary(len, &output);
-  memcpy(output.data, json, len);
+  copy = enif_alloc(opts.size + 1);
+  if (copy == NULL) return error_tuple(env, "Out of memory");
+  memcpy(copy, opts.data, opts.size);
+  copy[opts.size] = '\0';
 
-  if (tear_down_isolate(thread) != 0) {
-    enif_release_binary(&output);
-    return error_tuple(env, "Failed to tear down isolate");
-  }
+  json = ys_ffi_eval_json(res->program, copy, alloc_binary, &output, NULL);
+  enif_free(copy);
 
+  if (json == NULL) return error_tuple(env, "Out of memory");
   return enif_make_binary(env, &output);
 }
 
+// The load info is the dirty CPU scheduler count:
+static int pool_size(ErlNifEnv *env, ERL_NIF_TERM info) {
+  ErlNifSysInfo sys;
+  int size;
+
+  if (enif_get_int(env, info, &size) && size > 0) return size;
+  enif_system_info(&sys, sizeof(sys));
+  return sys.scheduler_threads > 0 ? sys.scheduler_threads : 1;
+}
+
 static int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM info) {
-  (void)env;
-  (void)priv_data;
-  (void)info;
-  open_libys();
+  if (open_program_type(env, ERL_NIF_RT_CREATE) != 0) return -1;
+  ys_ffi_open(YAMLSCRIPT_VERSION, NULL);
+  *priv_data = ys_ffi_pool_create(pool_size(env, info));
   return 0;
 }
 
+// Keep the warm isolates across a hot code upgrade:
+static int upgrade(
+  ErlNifEnv *env, void **priv_data, void **old_priv_data,
+  ERL_NIF_TERM info
+) {
+  ys_ffi_pool *pool = ys_ffi_pool_adopt(*old_priv_data);
+
+  if (pool == NULL) return load(env, priv_data, info);
+  // Live programs belong to the adopted pool, so take them over too:
+  if (open_program_type(env, ERL_NIF_RT_TAKEOVER) != 0) return -1;
+  ys_ffi_open(YAMLSCRIPT_VERSION, NULL);
+  *priv_data = pool;
+  *old_priv_data = NULL;
+  return 0;
+}
+
+static void unload(ErlNifEnv *env, void *priv_data) {
+  (void)env;
+  ys_ffi_pool_destroy(priv_data);
+}
+
 static ErlNifFunc funcs[] = {
+  {"nif_load_term", 1, load_term_nif, ERL_NIF_DIRTY_JOB_CPU_BOUND},
   {"nif_load_json", 1, load_json_nif, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_compile", 1, compile_nif, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_eval_json", 2, eval_json_nif, ERL_NIF_DIRTY_JOB_CPU_BOUND},
+  {"nif_load_batch_json", 1, load_batch_json_nif,
+   ERL_NIF_DIRTY_JOB_CPU_BOUND},
 };
 
-ERL_NIF_INIT(yamlscript, funcs, load, NULL, NULL, NULL)
+ERL_NIF_INIT(yamlscript, funcs, load, NULL, upgrade, unload)
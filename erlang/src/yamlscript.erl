@@ -1,33 +1,92 @@
 -module(yamlscript).
 -on_load(load_nif/0).
 
--export([load/1, load_json/1]).
--export([nif_load_json/1]).
+-export([load/1, load_json/1, load_batch/1, load_batch_json/1]).
+-export([compile/1, eval/1, eval/2]).
+-export([nif_load_term/1, nif_load_json/1, nif_load_batch_json/1]).
+-export([nif_compile/1, nif_eval_json/2]).
 
+%% The NIF keeps one libys isolate per dirty CPU scheduler:
 load_nif() ->
   Priv = filename:join(filename:dirname(code:which(?MODULE)), "../priv"),
-  erlang:load_nif(filename:join(Priv, "yamlscript_nif"), 0).
+  erlang:load_nif(filename:join(Priv, "yamlscript_nif"),
+    erlang:system_info(dirty_cpu_schedulers)).
 
 load(Input) when is_list(Input) ->
   load(list_to_binary(Input));
+%% The NIF builds the response map directly from the libys CBOR
+%% encoding, with no JSON step in between:
 load(Input) when is_binary(Input) ->
-  case load_json(Input) of
+  case nif_load_term(Input) of
+    {error, Message} ->
+      {error, Message};
+    Resp ->
+      response(Resp)
+  end.
+
+%% Load a list of inputs in one libys call. Returns a list with an
+%% {ok, Data} or {error, Cause} result per input, or {error, Cause} if
+%% libys could not be called at all:
+load_batch(Inputs) when is_list(Inputs) ->
+  case load_batch_json([iolist_to_binary(I) || I <- Inputs]) of
     {error, Message} ->
       {error, Message};
     JSON ->
-      Resp = json:decode(JSON),
-      case maps:get(<<"error">>, Resp, null) of
-        null ->
-          {ok, maps:get(<<"data">>, Resp)};
-        Error ->
-          {error, maps:get(<<"cause">>, Error)}
+      case json:decode(JSON) of
+        Resps when is_list(Resps) ->
+          [response(Resp) || Resp <- Resps];
+        Resp ->
+          response(Resp)
       end
   end.
 
+%% Compile once for any number of evals, which skip parsing and
+%% compiling. Compile errors are returned by each eval. The program is
+%% freed when it is garbage collected:
+compile(Input) ->
+  nif_compile(iolist_to_binary(Input)).
+
+%% Opts may have args (a list of binaries, for ARGS) and env (a map of
+%% binaries, merged over the process ENV):
+eval(Program) ->
+  eval(Program, #{}).
+
+eval(Program, Opts) when is_map(Opts) ->
+  JSON = iolist_to_binary(json:encode(maps:with([args, env], Opts))),
+  case nif_eval_json(Program, JSON) of
+    {error, Message} ->
+      {error, Message};
+    Resp ->
+      response(json:decode(Resp))
+  end.
+
+response(Resp) ->
+  case maps:get(<<"error">>, Resp, null) of
+    null ->
+      {ok, maps:get(<<"data">>, Resp)};
+    Error ->
+      {error, maps:get(<<"cause">>, Error)}
+  end.
+
 load_json(Input) when is_list(Input) ->
   load_json(list_to_binary(Input));
 load_json(Input) when is_binary(Input) ->
   nif_load_json(Input).
 
+load_batch_json(Inputs) when is_list(Inputs) ->
+  nif_load_batch_json(Inputs).
+
+nif_load_term(_Input) ->
+  erlang:nif_error(nif_not_loaded).
+
 nif_load_json(_Input) ->
   erlang:nif_error(nif_not_loaded).
+
+nif_load_batch_json(_Inputs) ->
+  erlang:nif_error(nif_not_loaded).
+
+nif_compile(_Input) ->
+  erlang:nif_error(nif_not_loaded).
+
+nif_eval_json(_Program, _Opts) ->
+  erlang:nif_error(nif_not_loaded).
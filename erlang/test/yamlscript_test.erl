@@ -4,4 +4,17 @@
 run() ->
   {ok, #{<<"test">> := 42}} =
     yamlscript:load(<<"!ys-0:\ntest:: inc(41)">>),
-  io:format("ok - load ys code~n").
+  io:format("ok - load ys code~n"),
+  {ok, #{<<"float">> := 1.5, <<"null">> := null, <<"bool">> := true,
+         <<"list">> := [1, [2, 3], #{<<"a">> := -4}]}} =
+    yamlscript:load(<<"float: 1.5\nnull: null\nbool: true\n"
+                      "list: [1, [2, 3], {a: -4}]\n">>),
+  io:format("ok - load native types~n"),
+  [{ok, #{<<"test">> := 42}}, {error, _}, {ok, #{<<"foo">> := <<"bar">>}}] =
+    yamlscript:load_batch(
+      [<<"!ys-0:\ntest:: inc(41)">>, <<":">>, <<"foo: bar">>]),
+  io:format("ok - load batch~n"),
+  Program = yamlscript:compile(<<"!ys-0:\ntest:: ARGS.0 + 1">>),
+  {ok, #{<<"test">> := 42}} = yamlscript:eval(Program, #{args => [<<"41">>]}),
+  {ok, #{<<"test">> := 2}} = yamlscript:eval(Program, #{args => [<<"1">>]}),
+  io:format("ok - compile and eval~n").
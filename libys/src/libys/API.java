@@ -3,17 +3,285 @@
 
 package libys;
 
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.InputStreamReader;
+import java.io.Reader;
+import java.nio.ByteBuffer;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicLong;
+
+import org.graalvm.nativeimage.UnmanagedMemory;
 import org.graalvm.nativeimage.c.function.CEntryPoint;
 import org.graalvm.nativeimage.c.type.CCharPointer;
+import org.graalvm.nativeimage.c.type.CCharPointerPointer;
+import org.graalvm.nativeimage.c.type.CLongPointer;
 import org.graalvm.nativeimage.c.type.CTypeConversion;
 import org.graalvm.nativeimage.c.type.CConst;
+import org.graalvm.word.WordFactory;
 
 public final class API {
+    // The C string returned by load_ys_to_json must outlive the call,
+    // so each thread keeps its last one until its next call:
+    private static final ThreadLocal<CTypeConversion.CCharPointerHolder>
+        lastResult = new ThreadLocal<>();
+
+    // A load_ys_to_json_into result that did not fit the caller's
+    // buffer, kept until the caller fetches it with a NULL input:
+    private static final ThreadLocal<byte[]> pendingResult =
+        new ThreadLocal<>();
+
+    // Programs from ys_compile, by handle, until ys_release. Handles
+    // belong to the isolate that made them:
+    private static final Map<Long, Object> programs =
+        new ConcurrentHashMap<>();
+    private static final AtomicLong lastProgram = new AtomicLong();
+
+    // The returned string is owned by libys and stays valid until the
+    // next load_ys_to_json call on the same isolate thread.
     @CEntryPoint(name = "load_ys_to_json")
     public static @CConst CCharPointer loadYsToJson(
         @CEntryPoint.IsolateThreadContext long isolateId,
         @CConst CCharPointer s
     ) {
+        String json = load(s);
+
+        CTypeConversion.CCharPointerHolder holder =
+            CTypeConversion.toCString(json);
+        CTypeConversion.CCharPointerHolder last = lastResult.get();
+        if (last != null) {
+            last.close();
+        }
+        lastResult.set(holder);
+
+        return holder.get();
+    }
+
+    // Write the UTF-8 JSON response into the caller's buffer and
+    // return its byte length. The response is NUL terminated when
+    // there is room for it.
+    //
+    // If it does not fit, nothing is written and the response is kept
+    // for this isolate thread. Call again with a NULL input and a big
+    // enough buffer to get it without evaluating the input twice.
+    // Returns -1 for a NULL input with no kept response.
+    @CEntryPoint(name = "load_ys_to_json_into")
+    public static long loadYsToJsonInto(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer s,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (s.isNull()) {
+            return fetch(buffer, size);
+        }
+
+        return into(load(s).getBytes(StandardCharsets.UTF_8), buffer, size);
+    }
+
+    // Compile and eval count YS strings in one call. Input i is
+    // lengths[i] bytes of UTF-8, which need not be NUL terminated, or
+    // a NUL terminated string if lengths is NULL. The response is a
+    // JSON array with one response object per input, in input order.
+    // It is written like load_ys_to_json_into writes it; NULL inputs
+    // fetch a kept response.
+    @CEntryPoint(name = "load_ys_batch_to_json")
+    public static long loadYsBatchToJson(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointerPointer inputs,
+        @CConst CLongPointer lengths,
+        int count,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (inputs.isNull()) {
+            return fetch(buffer, size);
+        }
+
+        String[] ys = new String[count];
+        for (int i = 0; i < count; i++) {
+            ys[i] = lengths.isNull()
+                ? CTypeConversion.toJavaString(inputs.read(i))
+                : CTypeConversion.toJavaString(inputs.read(i),
+                    WordFactory.unsigned(lengths.read(i)),
+                    StandardCharsets.UTF_8);
+        }
+        debug("API - called loadYsBatchToJson: " + count);
+        String json = libys.core.loadYsBatchToJson(ys);
+
+        return into(json.getBytes(StandardCharsets.UTF_8), buffer, size);
+    }
+
+    // Compile and eval length bytes of UTF-8 YS at input; no NUL
+    // terminator is needed. The bytes are decoded as the parser reads
+    // them, so no Java String copy of the input is made. The response
+    // is written like load_ys_to_json_into writes it; a NULL input
+    // fetches a kept response.
+    @CEntryPoint(name = "load_ys_buffer_to_json")
+    public static long loadYsBufferToJson(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer input,
+        long length,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (input.isNull()) {
+            return fetch(buffer, size);
+        }
+
+        String json = loadBuffer(input, length);
+
+        return into(json.getBytes(StandardCharsets.UTF_8), buffer, size);
+    }
+
+    // Like load_ys_buffer_to_json, but the response is encoded as CBOR
+    // (RFC 8949) instead of JSON, with native integers and floats and
+    // length prefixed strings.
+    @CEntryPoint(name = "load_ys_to_cbor")
+    public static long loadYsToCbor(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer input,
+        long length,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (input.isNull()) {
+            return fetch(buffer, size);
+        }
+
+        debug("API - called loadYsToCbor: " + length);
+
+        if (length < 0 || length > Integer.MAX_VALUE) {
+            return into(libys.core.errorToCbor(invalidLength(length)),
+                buffer, size);
+        }
+
+        ByteBuffer bytes = CTypeConversion.asByteBuffer(input, (int) length);
+
+        return into(libys.core.loadYsReaderToCbor(reader(bytes), null),
+            buffer, size);
+    }
+
+    // Compile and eval the YS file at path. The file is mapped
+    // read-only and decoded as the parser reads it, so no Java String
+    // copy of the input is made. The response is written like
+    // load_ys_to_json_into writes it; a NULL path fetches a kept
+    // response.
+    @CEntryPoint(name = "load_ys_file_to_json")
+    public static long loadYsFileToJson(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer path,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (path.isNull()) {
+            return fetch(buffer, size);
+        }
+
+        String json = loadFile(CTypeConversion.toJavaString(path));
+
+        return into(json.getBytes(StandardCharsets.UTF_8), buffer, size);
+    }
+
+    // Compile a YS string once and return a handle (always positive)
+    // to the program, to be evaluated any number of times by ys_eval
+    // and freed by ys_release. A compile error is kept in the program
+    // and returned as the response of every ys_eval.
+    @CEntryPoint(name = "ys_compile")
+    public static long ysCompile(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer s
+    ) {
+        debug("API - called ysCompile");
+
+        long handle = lastProgram.incrementAndGet();
+        programs.put(handle,
+            libys.core.compileYs(CTypeConversion.toJavaString(s)));
+
+        return handle;
+    }
+
+    // Evaluate a program from ys_compile. opts is NULL or a JSON object
+    // with optional "args" (an array of strings for ARGS and ARGV) and
+    // "env" (an object merged over the process ENV). The JSON response
+    // is written like load_ys_to_json_into writes it; a handle of 0
+    // fetches a kept response.
+    @CEntryPoint(name = "ys_eval")
+    public static long ysEval(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        long handle,
+        @CConst CCharPointer opts,
+        CCharPointer buffer,
+        long size
+    ) {
+        if (handle == 0) {
+            return fetch(buffer, size);
+        }
+
+        debug("API - called ysEval: " + handle);
+
+        Object program = programs.get(handle);
+        String json = program == null
+            ? libys.core.errorToJson(new IllegalArgumentException(
+                "Unknown program handle: " + handle))
+            : libys.core.evalCompiledToJson(program,
+                CTypeConversion.toJavaString(opts));
+
+        return into(json.getBytes(StandardCharsets.UTF_8), buffer, size);
+    }
+
+    // Free a program from ys_compile. Returns 0, or -1 for an unknown
+    // handle.
+    @CEntryPoint(name = "ys_release")
+    public static int ysRelease(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        long handle
+    ) {
+        return programs.remove(handle) != null ? 0 : -1;
+    }
+
+    // Return the UTF-8 JSON response in NUL terminated memory that the
+    // caller frees with ys_free. Sets *length to its byte length
+    // unless length is NULL. Returns NULL if no memory is left.
+    @CEntryPoint(name = "load_ys_to_json_alloc")
+    public static CCharPointer loadYsToJsonAlloc(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        @CConst CCharPointer s,
+        CLongPointer length
+    ) {
+        byte[] json = load(s).getBytes(StandardCharsets.UTF_8);
+        CCharPointer buffer;
+
+        try {
+            buffer = UnmanagedMemory.malloc(json.length + 1);
+        } catch (OutOfMemoryError e) {
+            return WordFactory.nullPointer();
+        }
+
+        write(buffer, json, true);
+        if (length.isNonNull()) {
+            length.write(json.length);
+        }
+        return buffer;
+    }
+
+    @CEntryPoint(name = "ys_free")
+    public static void ysFree(
+        @CEntryPoint.IsolateThreadContext long isolateId,
+        CCharPointer pointer
+    ) {
+        if (pointer.isNonNull()) {
+            UnmanagedMemory.free(pointer);
+        }
+    }
+
+    private static String load(CCharPointer s) {
         debug("API - called loadYsToJson");
 
         String ys = CTypeConversion.toJavaString(s);
@@ -24,11 +292,104 @@ public final class API {
 
         debug("API - java response string: " + json);
 
-        try (CTypeConversion.CCharPointerHolder holder =
-                CTypeConversion.toCString(json)
+        return json;
+    }
+
+    private static String loadBuffer(CCharPointer input, long length) {
+        debug("API - called loadYsBufferToJson: " + length);
+
+        if (length < 0 || length > Integer.MAX_VALUE) {
+            return libys.core.errorToJson(invalidLength(length));
+        }
+
+        ByteBuffer bytes = CTypeConversion.asByteBuffer(input, (int) length);
+
+        return libys.core.loadYsReaderToJson(reader(bytes), null);
+    }
+
+    private static String loadFile(String path) {
+        debug("API - called loadYsFileToJson: " + path);
+
+        try (FileChannel channel =
+                FileChannel.open(Paths.get(path), StandardOpenOption.READ)
         ) {
-            CCharPointer value = holder.get();
-            return value;
+            MappedByteBuffer bytes = channel.map(
+                FileChannel.MapMode.READ_ONLY, 0, channel.size());
+
+            return libys.core.loadYsReaderToJson(reader(bytes), path);
+        } catch (IOException | RuntimeException e) {
+            return libys.core.errorToJson(e);
+        }
+    }
+
+    private static Exception invalidLength(long length) {
+        return new IllegalArgumentException(
+            "Invalid input length: " + length);
+    }
+
+    private static Reader reader(ByteBuffer bytes) {
+        return new InputStreamReader(
+            new ByteBufferInputStream(bytes), StandardCharsets.UTF_8);
+    }
+
+    private static long fetch(CCharPointer buffer, long size) {
+        byte[] json = pendingResult.get();
+        if (json == null) {
+            return -1;
+        }
+        return into(json, buffer, size);
+    }
+
+    private static long into(byte[] json, CCharPointer buffer, long size) {
+        pendingResult.remove();
+
+        if (buffer.isNull() || size < json.length) {
+            pendingResult.set(json);
+            return json.length;
+        }
+
+        write(buffer, json, size > json.length);
+        return json.length;
+    }
+
+    private static void write(
+        CCharPointer buffer, byte[] bytes, boolean terminate
+    ) {
+        CTypeConversion.asByteBuffer(buffer, bytes.length).put(bytes);
+        if (terminate) {
+            buffer.write(bytes.length, (byte) 0);
+        }
+    }
+
+    // Read a (mapped) byte buffer as a stream, without copying it:
+    private static final class ByteBufferInputStream extends InputStream {
+        private final ByteBuffer buffer;
+
+        ByteBufferInputStream(ByteBuffer buffer) {
+            this.buffer = buffer;
+        }
+
+        @Override
+        public int read() {
+            return buffer.hasRemaining() ? buffer.get() & 0xff : -1;
+        }
+
+        @Override
+        public int read(byte[] bytes, int offset, int length) {
+            if (length == 0) {
+                return 0;
+            }
+            if (!buffer.hasRemaining()) {
+                return -1;
+            }
+            length = Math.min(length, buffer.remaining());
+            buffer.get(bytes, offset, length);
+            return length;
+        }
+
+        @Override
+        public int available() {
+            return buffer.remaining();
         }
     }
 
@@ -0,0 +1,119 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+;; A CBOR (RFC 8949) encoder for libys responses.
+;;
+;; It encodes the same data model as the JSON responses (keywords and symbols
+;; become strings, any sequential or set becomes an array), but with native
+;; integers and floats and length prefixed strings, so that bindings can build
+;; host values directly without a text decoding step.
+;;
+;; Integers outside the 64 bit range use the bignum tags (2 and 3). Floats
+;; are always written as 64 bit doubles.
+
+(ns libys.cbor
+  (:import
+   (clojure.lang BigInt Named)
+   (java.io ByteArrayOutputStream)
+   (java.math BigInteger)
+   (java.nio.charset StandardCharsets)
+   (java.util Arrays Collection Map Map$Entry UUID)))
+
+(declare write-value)
+
+(defn- write-be
+  "Write the low size bytes of n, most significant first."
+  [^ByteArrayOutputStream out ^long n ^long size]
+  (loop [i (dec size)]
+    (when (>= i 0)
+      (.write out (int (bit-and 0xff (unsigned-bit-shift-right n (* 8 i)))))
+      (recur (dec i)))))
+
+(defn- write-head
+  "Write a data item head for a major type and its (non-negative) argument."
+  [^ByteArrayOutputStream out ^long major ^long n]
+  (let [mt (bit-shift-left major 5)]
+    (cond
+      (< n 24) (.write out (int (bit-or mt n)))
+      (< n 0x100) (do (.write out (int (bit-or mt 24))) (write-be out n 1))
+      (< n 0x10000) (do (.write out (int (bit-or mt 25))) (write-be out n 2))
+      (< n 0x100000000) (do (.write out (int (bit-or mt 26)))
+                            (write-be out n 4))
+      :else (do (.write out (int (bit-or mt 27))) (write-be out n 8)))))
+
+(defn- write-int [out ^long n]
+  (if (neg? n)
+    (write-head out 1 (- -1 n))
+    (write-head out 0 n)))
+
+(defn- write-bigint [out ^BigInteger n]
+  (if (< (.bitLength n) 64)
+    (write-int out (.longValue n))
+    ;; Tag 3 holds -1 - n for negative numbers:
+    (let [neg (neg? (.signum n))
+          ^BigInteger m (if neg (.subtract (.negate n) BigInteger/ONE) n)
+          ^bytes bytes (.toByteArray m)
+          ^bytes bytes (if (zero? (aget bytes 0))
+                         (Arrays/copyOfRange bytes 1 (alength bytes))
+                         bytes)]
+      (write-head out 6 (if neg 3 2))
+      (write-head out 2 (alength bytes))
+      (.write ^ByteArrayOutputStream out bytes 0 (alength bytes)))))
+
+(defn- write-float [^ByteArrayOutputStream out ^double d]
+  (.write out (int 0xfb))
+  (write-be out (Double/doubleToRawLongBits d) 8))
+
+(defn- write-text [^ByteArrayOutputStream out ^String s]
+  (let [bytes (.getBytes s StandardCharsets/UTF_8)]
+    (write-head out 3 (alength bytes))
+    (.write out bytes 0 (alength bytes))))
+
+(defn- write-key
+  "Map keys are always strings, like the JSON response keys."
+  [out k]
+  (write-text out (if (instance? Named k) (name k) (str k))))
+
+(defn- write-map [out ^Map m]
+  (write-head out 5 (.size m))
+  (doseq [^Map$Entry entry (.entrySet m)]
+    (write-key out (.getKey entry))
+    (write-value out (.getValue entry))))
+
+(defn- write-array [out xs]
+  (let [xs (if (counted? xs) xs (vec xs))]
+    (write-head out 4 (count xs))
+    (doseq [x xs]
+      (write-value out x))))
+
+(defn- write-value [^ByteArrayOutputStream out x]
+  (cond
+    (nil? x) (.write out (int 0xf6))
+    (string? x) (write-text out x)
+    (boolean? x) (.write out (int (if x 0xf5 0xf4)))
+    (or (instance? Long x)
+      (instance? Integer x)
+      (instance? Short x)
+      (instance? Byte x)) (write-int out (long x))
+    (or (instance? Double x) (instance? Float x)) (write-float out (double x))
+    (instance? Map x) (write-map out x)
+    (instance? Named x) (write-text out (name x))
+    (or (sequential? x) (set? x) (instance? Collection x)) (write-array out x)
+    (instance? BigInt x) (write-bigint out (.toBigInteger ^BigInt x))
+    (instance? BigInteger x) (write-bigint out x)
+    (or (ratio? x) (decimal? x)) (write-float out (double x))
+    (char? x) (write-text out (str x))
+    (instance? UUID x) (write-text out (str x))
+    (.isArray (class x)) (write-array out (seq x))
+    :else (throw (Exception.
+                   (str "Don't know how to write CBOR of " (class x))))))
+
+(defn encode
+  "Encode a value as CBOR and return the bytes."
+  ^bytes [x]
+  (let [out (ByteArrayOutputStream.)]
+    (write-value out x)
+    (.toByteArray out)))
+
+(comment
+  )
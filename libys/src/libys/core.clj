@@ -6,14 +6,25 @@
 (ns libys.core
   (:require
    [clojure.data.json :as json]
+   [clojure.string :as str]
+   [libys.cbor :as cbor]
    [sci.core :as sci]
    [ys.v0.common]
    [yamlscript.compiler :as compiler]
+   [yamlscript.global :as global]
+   [yamlscript.profile :as profile]
    [yamlscript.runtime :as runtime])
   (:gen-class
-   :methods [^:static [loadYsToJson [String] String]]))
+   :methods [^:static [loadYsToJson [String] String]
+             ^:static [loadYsBatchToJson ["[Ljava.lang.String;"] String]
+             ^:static [loadYsReaderToJson [java.io.Reader String] String]
+             ^:static [loadYsReaderToCbor [java.io.Reader String] "[B"]
+             ^:static [compileYs [String] Object]
+             ^:static [evalCompiledToJson [Object String] String]
+             ^:static [errorToJson [Throwable] String]
+             ^:static [errorToCbor [Throwable] "[B"]]))
 
-(declare json-write-str error-map debug)
+(declare eval-reader data-response json-write-str error-map debug)
 
 (defn -loadYsToJson
   "Convert a YS code string to Clojure, eval the Clojure code with SCI, encode
@@ -22,10 +33,10 @@
   (debug "CLJ libys load - input string:" ys-str)
   (let [resp (sci/binding [sci/out *out*]
                (try
-                 (->> ys-str
-                   compiler/compile
-                   runtime/eval-string
-                   (assoc {} :data)
+                 (-> #(let [forms (compiler/compile-forms ys-str)]
+                        (profile/measure "eval"
+                          (fn [] (runtime/eval-code forms))))
+                   data-response
                    json-write-str)
 
                  (catch Exception e
@@ -35,6 +46,146 @@
     (debug "CLJ libys load - response string:" resp)
     resp))
 
+(defn -loadYsBatchToJson
+  "Like loadYsToJson for many YS code strings at once. Each one is evaluated
+  in its own runtime (see runtime/with-runtime), so nothing one defines is
+  seen by the next. Return a JSON array with one response object
+  ({\"data\": ...} or {\"error\": ...}) per input, in input order."
+  [^"[Ljava.lang.String;" ys-strs]
+  (debug "CLJ libys batch load - inputs:" (count ys-strs))
+  (let [load-one (fn [ys-str]
+                   (try
+                     (->> ys-str
+                       compiler/compile-forms
+                       runtime/eval-code
+                       (assoc {} :data)
+                       json-write-str)
+
+                     (catch Exception e
+                       (-> e
+                         error-map
+                         json-write-str))))
+        resps (sci/binding [sci/out *out*]
+                (mapv load-one ys-strs))
+        resp (str "[" (str/join "," resps) "]")]
+    (debug "CLJ libys batch load - response string:" resp)
+    resp))
+
+(defn -loadYsReaderToJson
+  "Like loadYsToJson but read the YS code from a reader, so the input is
+  never built into one big string. file is the path the code was read from,
+  if any; the runtime FILE and DIR vars are set from it."
+  [^java.io.Reader reader ^String file]
+  (debug "CLJ libys load - input file:" file)
+  (let [resp (sci/binding [sci/out *out*]
+               (try
+                 (-> #(eval-reader reader file)
+                   data-response
+                   json-write-str)
+
+                 (catch Exception e
+                   (-> e
+                     error-map
+                     json-write-str))))]
+    (debug "CLJ libys load - response string:" resp)
+    resp))
+
+(defn -loadYsReaderToCbor
+  "Like loadYsReaderToJson but return the response encoded as CBOR (see
+  libys.cbor), so bindings can decode it without a JSON step."
+  [^java.io.Reader reader ^String file]
+  (debug "CLJ libys CBOR load - input file:" file)
+  (sci/binding [sci/out *out*]
+    (try
+      (-> #(eval-reader reader file)
+        data-response
+        cbor/encode)
+
+      (catch Exception e
+        (-> e
+          error-map
+          cbor/encode)))))
+
+(defn -compileYs
+  "Compile a YS code string into Clojure forms, for evalCompiledToJson to
+  evaluate any number of times. A compile error is kept in the program and
+  returned by every evaluation of it."
+  [^String ys-str]
+  (debug "CLJ libys compile - input string:" ys-str)
+  (try
+    {:forms (compiler/compile-forms ys-str)}
+
+    (catch Exception e
+      {:error e})))
+
+(defn -evalCompiledToJson
+  "Evaluate a program from compileYs and return the JSON response. opts-json
+  is nil or a JSON object with an optional \"args\" array (the ARGS and ARGV
+  of this evaluation) and an optional \"env\" object (merged over the process
+  environment for ENV)."
+  [program ^String opts-json]
+  (let [{:keys [forms error]} program
+        resp (sci/binding [sci/out *out*]
+               (try
+                 (when error (throw error))
+                 (let [opts (if (str/blank? opts-json)
+                              {}
+                              (json/read-str opts-json))
+                       args (mapv str (get opts "args"))
+                       env (get opts "env")
+                       eval-all #(runtime/eval-forms forms)]
+                   (->> (runtime/with-runtime @sci/file args
+                          (if env
+                            #(sci/binding [global/ENV (merge @global/ENV env)]
+                               (eval-all))
+                            eval-all))
+                     (assoc {} :data)
+                     json-write-str))
+
+                 (catch Exception e
+                   (-> e
+                     error-map
+                     json-write-str))))]
+    (debug "CLJ libys eval - response string:" resp)
+    resp))
+
+(defn -errorToJson
+  "Return the JSON error response for an exception thrown outside of the
+  compiler and runtime (like failing to read an input file)."
+  [^Throwable e]
+  (-> e
+    error-map
+    json-write-str))
+
+(defn -errorToCbor
+  "Like errorToJson, encoded as CBOR."
+  [^Throwable e]
+  (-> e
+    error-map
+    cbor/encode))
+
+(defn eval-reader
+  "Compile and eval YS code read from a reader. file is the path the code was
+  read from, if any."
+  [reader file]
+  (let [forms (compiler/compile-forms reader)]
+    (profile/measure "eval"
+      #(if file
+         (runtime/eval-code forms file)
+         (runtime/eval-code forms)))))
+
+(defn data-response
+  "Return the {:data ...} response for the value of calling f. With
+  YS_PROFILE=json in the environment, the compile and eval in f are profiled
+  and the profile record is added to the response as \"profile\"."
+  [f]
+  (if (contains? profile/formats (System/getenv "YS_PROFILE"))
+    (binding [profile/*profile* (profile/start)]
+      (let [data (f)]
+        {:data data
+         :profile (profile/record @profile/*profile*)}))
+    {:data (f)}))
+
 (defn json-write-str [data]
   (json/write-str
     data
@@ -1,122 +1,45 @@
 #include "moonbit.h"
 
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <dlfcn.h>
-#endif
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 
-#define YS_VERSION "0.2.31"
+#include "libys_ffi.h"
 
-typedef int (*graal_create_isolate_fn)(void *, void *, void *);
-typedef int (*graal_tear_down_isolate_fn)(void *);
-typedef char *(*load_ys_to_json_fn)(void *, char *);
+#define YS_VERSION "0.2.31"
 
-static void *libys = NULL;
-static void *isolate_thread = NULL;
-static load_ys_to_json_fn load_ys = NULL;
-static graal_tear_down_isolate_fn tear_down_isolate = NULL;
+// Finding libys and the isolate are handled by the shared libys-ffi
+// helper library (libys_ffi.c). MoonBit native code calls in from one
+// thread, so a single long-lived isolate is kept:
+static ys_ffi_pool *pool = NULL;
 
 static void fail(const char *message) {
   fprintf(stderr, "YAMLScript MoonBit binding error: %s\n", message);
   abort();
 }
 
-#ifdef _WIN32
-static void *dl_open(const char *name) {
-  return (void *)LoadLibraryA(name);
-}
-static void *dl_sym(void *handle, const char *symbol) {
-  return (void *)GetProcAddress((HMODULE)handle, symbol);
-}
-static const char *dl_error(void) {
-  return "could not load libys.dll";
-}
-#else
-static void *dl_open(const char *name) {
-  return dlopen(name, RTLD_LAZY);
-}
-static void *dl_sym(void *handle, const char *symbol) {
-  return dlsym(handle, symbol);
-}
-static const char *dl_error(void) {
-  return dlerror();
-}
-#endif
-
-static void open_libys(void) {
-  if (libys != NULL) {
-    return;
-  }
-
-  const char *names[] = {
-#if defined(_WIN32)
-    "libys.dll",
-#elif defined(__APPLE__)
-    "libys.dylib." YS_VERSION,
-    "libys.dylib",
-#else
-    "libys.so." YS_VERSION,
-    "libys.so",
-#endif
-    NULL,
-  };
-
-  for (int i = 0; names[i] != NULL; i++) {
-    libys = dl_open(names[i]);
-    if (libys != NULL) {
-      break;
-    }
-  }
-
-  if (libys == NULL) {
-    fail(dl_error());
-  }
-
-  graal_create_isolate_fn create_isolate =
-    (graal_create_isolate_fn)dl_sym(libys, "graal_create_isolate");
-  tear_down_isolate =
-    (graal_tear_down_isolate_fn)dl_sym(libys, "graal_tear_down_isolate");
-  load_ys = (load_ys_to_json_fn)dl_sym(libys, "load_ys_to_json");
-
-  if (
-    create_isolate == NULL ||
-    tear_down_isolate == NULL ||
-    load_ys == NULL
-  ) {
-    fail("required libys symbol not found");
-  }
-
-  if (create_isolate(NULL, NULL, &isolate_thread) != 0) {
-    fail("failed to create GraalVM isolate");
-  }
+// Let libys-ffi write the response straight into MoonBit bytes:
+static char *alloc_bytes(void *ctx, size_t size) {
+  moonbit_bytes_t *bytes = ctx;
+  *bytes = moonbit_make_bytes_raw((int32_t)size);
+  return (char *)*bytes;
 }
 
 moonbit_bytes_t ys_load_ys_to_json(moonbit_bytes_t input) {
-  open_libys();
-
-  int32_t len = Moonbit_array_length(input);
-  char *source = (char *)malloc((size_t)len + 1);
-  if (source == NULL) {
-    fail("failed to allocate input buffer");
+  if (pool == NULL) {
+    ys_ffi_open(YS_VERSION, NULL);
+    pool = ys_ffi_pool_create(1);
   }
 
-  memcpy(source, input, (size_t)len);
-  source[len] = '\0';
-
-  char *json = load_ys(isolate_thread, source);
-  free(source);
+  // libys reads the input bytes in place (no NUL terminator needed):
+  int32_t len = Moonbit_array_length(input);
+  moonbit_bytes_t output = NULL;
+  char *json = ys_ffi_load_buffer_json(
+    pool, (const char *)input, (size_t)len, alloc_bytes, &output, NULL);
 
   if (json == NULL) {
-    fail("null response from libys");
+    fail("failed to allocate output buffer");
   }
 
-  int32_t out_len = (int32_t)strlen(json);
-  moonbit_bytes_t output = moonbit_make_bytes_raw(out_len);
-  memcpy(output, json, (size_t)out_len);
   return output;
 }
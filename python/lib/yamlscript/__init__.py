@@ -8,9 +8,11 @@ This module can be considered the reference implementation for YAMLScript
 FFI bindings to libys.
 
 The current user facing API consists of a single class, `YAMLScript`, which
-has a single method: `.load(string)`.
+has the methods `.load(string)` and `.compile(string)`.
 The load() method takes a YAMLScript string as input and returns the Python
 object that the YAMLScript code evaluates to.
+The compile() method returns a `Program` that can be evaluated many times with
+`.eval(args, env)`, without parsing and compiling the YAMLScript again.
 """
 
 # This value is automatically updated by 'make bump'.
@@ -88,6 +90,37 @@ libys = ctypes.CDLL(find_libys_path())
 load_ys_to_json = libys.load_ys_to_json
 load_ys_to_json.restype = ctypes.c_char_p
 
+# Create bindings to the compiled program functions:
+ys_compile = libys.ys_compile
+ys_compile.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+ys_compile.restype = ctypes.c_longlong
+
+ys_eval = libys.ys_eval
+ys_eval.argtypes = [
+  ctypes.c_void_p, ctypes.c_longlong, ctypes.c_char_p,
+  ctypes.c_char_p, ctypes.c_longlong]
+ys_eval.restype = ctypes.c_longlong
+
+ys_release = libys.ys_release
+ys_release.argtypes = [ctypes.c_void_p, ctypes.c_longlong]
+ys_release.restype = ctypes.c_int
+
+# Check a libys JSON response and return its data. The error of a failed
+# response is kept in obj.error (None when there is none), for the load()
+# and eval() callers to look at:
+def response_data(obj, data_json):
+  resp = json.loads(data_json)
+
+  # Check for libys error in JSON response:
+  obj.error = resp.get('error')
+  if obj.error:
+    raise Exception(obj.error['cause'])
+
+  # Get the response object from evaluating the YAMLScript string:
+  if not 'data' in resp:
+    raise Exception("Unexpected response from 'libys'")
+  return resp.get('data')
+
 
 # The YAMLScript class is the main user facing API for this module.
 class YAMLScript():
@@ -129,21 +162,16 @@ class YAMLScript():
       ctypes.c_char_p(bytes(input, "utf8")),
     ).decode()
 
-    # Decode the JSON response:
-    resp = json.loads(data_json)
+    # Decode the JSON response and return its data:
+    return response_data(self, data_json)
 
-    # Check for libys error in JSON response:
-    self.error = resp.get('error')
-    if self.error:
-      raise Exception(self.error['cause'])
-
-    # Get the response object from evaluating the YAMLScript string:
-    if not 'data' in resp:
-      raise Exception("Unexpected response from 'libys'")
-    data = resp.get('data')
-
-    # Return the response object:
-    return data
+  # Compile a YAMLScript string once, to be evaluated many times:
+  def compile(self, input):
+    handle = ys_compile(
+      self.isolatethread,
+      ctypes.c_char_p(bytes(input, "utf8")),
+    )
+    return Program(self, handle)
 
   # YAMLScript instance destructor:
   def __del__(self):
@@ -151,3 +179,57 @@ class YAMLScript():
     rc = libys.graal_tear_down_isolate(self.isolatethread)
     if rc != 0:
       raise Exception("Failed to tear down isolate")
+
+
+# A compiled YAMLScript program, from YAMLScript.compile().
+class Program():
+  """
+  A YAMLScript program compiled once and evaluated any number of times.
+
+  Usage:
+    template = ys.compile(open('template.ys').read())
+    data = template.eval(args=['a'], env={'MODE': 'dev'})
+  """
+
+  def __init__(self, ys, handle):
+    # Keep the YAMLScript instance (and so its isolate) alive for as long
+    # as the program:
+    self.ys = ys
+    self.handle = handle
+    self.error = None
+
+  # Evaluate the program and return the result. args are the ARGS of this
+  # evaluation and env is merged over the process ENV. A compile error is
+  # raised here:
+  def eval(self, args=None, env=None):
+    # Reset any previous error:
+    self.error = None
+
+    if not self.handle:
+      raise Exception("Program has been released")
+
+    opts = {}
+    if args is not None:
+      opts['args'] = [str(arg) for arg in args]
+    if env is not None:
+      opts['env'] = env
+    opts = ctypes.c_char_p(bytes(json.dumps(opts), "utf8"))
+
+    # Evaluate once to get the response length, then fetch the kept
+    # response into a buffer of that size:
+    thread = self.ys.isolatethread
+    size = ys_eval(thread, self.handle, opts, None, 0)
+    buffer = ctypes.create_string_buffer(size + 1)
+    if ys_eval(thread, 0, None, buffer, size + 1) != size:
+      raise Exception("Unexpected response from 'libys'")
+
+    return response_data(self, buffer.raw[:size].decode())
+
+  # Free the compiled program in libys:
+  def release(self):
+    if self.handle:
+      ys_release(self.ys.isolatethread, self.handle)
+      self.handle = 0
+
+  def __del__(self):
+    self.release()
@@ -6,3 +6,32 @@ def modules_compile():
 
 def test_modules_compile():
     assert modules_compile() == "ok"
+
+
+@pytest.fixture(scope='module')
+def ys():
+    try:
+        import yamlscript
+    except Exception as e:
+        pytest.skip("libys is not available: %s" % e)
+    return yamlscript.YAMLScript()
+
+def test_program_eval_twice(ys):
+    program = ys.compile("!YS-v0:\nargs:: ARGS\nmode:: ENV.MODE\n")
+    assert program.eval(args=['a'], env={'MODE': 'dev'}) == \
+        {'args': ['a'], 'mode': 'dev'}
+    assert program.eval(args=['b', 'c'], env={'MODE': 'prod'}) == \
+        {'args': ['b', 'c'], 'mode': 'prod'}
+
+def test_program_eval_error(ys):
+    program = ys.compile("!YS-v0\ndie: 'Oops'\n")
+    with pytest.raises(Exception, match='Oops'):
+        program.eval()
+    assert 'Oops' in program.error['cause']
+
+def test_program_eval_after_release(ys):
+    program = ys.compile("!YS-v0:\na: 1\n")
+    assert program.eval() == {'a': 1}
+    program.release()
+    with pytest.raises(Exception, match='released'):
+        program.eval()
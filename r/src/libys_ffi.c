@@ -0,0 +1,1007 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// See libys_ffi.h for what this library is for. The library search
+// paths and exact version pinning are ported from the Python reference
+// implementation.
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libys_ffi.h"
+
+// Bump this when the ys_ffi_pool struct layout changes, so that a hot
+// upgrade never adopts a pool it can not read:
+#define POOL_VERSION 6
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION ffi_mutex;
+typedef DWORD ffi_key;
+typedef DWORD ffi_thread_id;
+typedef INIT_ONCE ffi_once;
+#define ONCE_INIT INIT_ONCE_STATIC_INIT
+#define run_once(o, fn) InitOnceExecuteOnce(o, once_call, (PVOID)(fn), NULL)
+#define mutex_init(m) (InitializeCriticalSection(m), 0)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+// TLS slots have no destructor on Windows, so threads there stay
+// attached until their isolate is torn down:
+#define key_create(k, d) ((void)(d), (*(k) = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+#define key_delete(k) TlsFree(k)
+#define key_get(k) TlsGetValue(k)
+#define key_set(k, v) TlsSetValue(k, v)
+#define thread_self() GetCurrentThreadId()
+#define thread_equal(a, b) ((a) == (b))
+#define lib_open(path) ((void *)LoadLibraryA(path))
+#define lib_sym(lib, name) ((void *)GetProcAddress((HMODULE)(lib), name))
+#define PATH_VAR "PATH"
+#define PATH_SEP ";"
+#define HOME_VAR "USERPROFILE"
+#else
+typedef pthread_mutex_t ffi_mutex;
+typedef pthread_key_t ffi_key;
+typedef pthread_t ffi_thread_id;
+typedef pthread_once_t ffi_once;
+#define ONCE_INIT PTHREAD_ONCE_INIT
+#define run_once(o, fn) pthread_once(o, fn)
+#define mutex_init(m) pthread_mutex_init(m, NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define key_create(k, d) pthread_key_create(k, d)
+#define key_delete(k) pthread_key_delete(k)
+#define key_get(k) pthread_getspecific(k)
+#define key_set(k, v) pthread_setspecific(k, v)
+#define thread_self() pthread_self()
+#define thread_equal(a, b) pthread_equal(a, b)
+#define lib_open(path) dlopen(path, RTLD_NOW)
+#define lib_sym(lib, name) dlsym(lib, name)
+#define PATH_VAR "LD_LIBRARY_PATH"
+#define PATH_SEP ":"
+#define HOME_VAR "HOME"
+#endif
+
+typedef int (*create_isolate_fn)(void *, void **, void **);
+typedef int (*attach_thread_fn)(void *, void **);
+typedef int (*isolate_thread_fn)(void *);
+typedef char *(*load_ys_to_json_fn)(void *, const char *);
+typedef long long (*load_ys_to_json_into_fn)(
+  void *, const char *, char *, long long);
+typedef long long (*load_ys_batch_to_json_fn)(
+  void *, const char *const *, const long long *, int, char *, long long);
+typedef long long (*load_ys_file_to_json_fn)(
+  void *, const char *, char *, long long);
+typedef long long (*load_ys_buffer_to_json_fn)(
+  void *, const char *, long long, char *, long long);
+typedef load_ys_buffer_to_json_fn load_ys_to_cbor_fn;
+typedef long long (*ys_compile_fn)(void *, const char *);
+typedef long long (*ys_eval_fn)(
+  void *, long long, const char *, char *, long long);
+typedef int (*ys_release_fn)(void *, long long);
+
+struct ys_ffi_pool {
+  int version;
+  int size;
+  int used;
+  void **isolates;
+  // The isolate thread each isolate was created with, and the OS
+  // thread that created it:
+  void **threads;
+  ffi_thread_id *owners;
+  ffi_mutex lock;
+  ffi_key key;
+  int shared;
+  // Held while a thread evaluates in a shared pool's isolate:
+  ffi_mutex eval_lock;
+  // Live programs, which keep the pool's isolates alive. Destroying
+  // the pool is put off until the last one is released:
+  int programs;
+  int closing;
+  // Program handles waiting to be released in their isolate:
+  struct release *releases;
+};
+
+// A program handle to release by the next call into its isolate:
+struct release {
+  int slot;
+  long long handle;
+  struct release *next;
+};
+
+// A compiled program: its source and the libys handle for it in each
+// of the pool's isolates, compiled on first use in that isolate:
+struct ys_ffi_program {
+  ys_ffi_pool *pool;
+  char *source;
+  long long *handles;
+  ffi_mutex lock;
+};
+
+static void *libys = NULL;
+static create_isolate_fn create_isolate;
+static attach_thread_fn attach_thread;
+static isolate_thread_fn detach_thread;
+static isolate_thread_fn tear_down_isolate;
+static isolate_thread_fn detach_all_and_tear_down;
+static load_ys_to_json_fn load_ys_to_json;
+static load_ys_to_json_into_fn load_ys_to_json_into;
+static load_ys_batch_to_json_fn load_ys_batch_to_json;
+static load_ys_file_to_json_fn load_ys_file_to_json;
+static load_ys_buffer_to_json_fn load_ys_buffer_to_json;
+static load_ys_to_cbor_fn load_ys_to_cbor;
+static ys_compile_fn ys_compile;
+static ys_eval_fn ys_eval;
+static ys_release_fn ys_release;
+static char load_error[1024] = "libys has not been opened";
+
+// ys_ffi_open may be called from many threads at once:
+static ffi_once open_once = ONCE_INIT;
+static ffi_mutex open_lock;
+
+static ffi_once shared_once = ONCE_INIT;
+static ys_ffi_pool *shared_pool = NULL;
+
+#ifdef _WIN32
+static BOOL CALLBACK once_call(PINIT_ONCE once, PVOID fn, PVOID *ctx) {
+  (void)once;
+  (void)ctx;
+  ((void (*)(void))fn)();
+  return TRUE;
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Finding and opening libys
+//------------------------------------------------------------------------------
+
+// Return 1 if the named libys file exists in dir and fill path:
+static int check_dir(
+  const char *dir, const char *name, char *path, size_t size
+) {
+  FILE *file;
+
+  snprintf(path, size, "%s/%s", dir, name);
+  file = fopen(path, "r");
+  if (file == NULL) return 0;
+  fclose(file);
+  return 1;
+}
+
+// Find the libys shared library file path. Search LD_LIBRARY_PATH
+// entries (PATH on Windows), then common install locations:
+static int find_libys(const char *name, char *path, size_t size) {
+  const char *library_path = getenv(PATH_VAR);
+  const char *home;
+
+  if (library_path != NULL) {
+    char *paths = strdup(library_path);
+    char *dir = paths != NULL ? strtok(paths, PATH_SEP) : NULL;
+    while (dir != NULL) {
+      if (check_dir(dir, name, path, size)) {
+        free(paths);
+        return 1;
+      }
+      dir = strtok(NULL, PATH_SEP);
+    }
+    free(paths);
+  }
+
+#ifndef _WIN32
+  if (check_dir("/usr/local/lib", name, path, size)) return 1;
+#endif
+  if (check_dir("../libys/lib", name, path, size)) return 1;
+
+  home = getenv(HOME_VAR);
+  if (home != NULL) {
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s/.local/lib", home);
+    if (check_dir(dir, name, path, size)) return 1;
+  }
+
+  return 0;
+}
+
+static int open_libys(const char *version, const char *path) {
+  char name[256];
+  char found[4096];
+  void *lib = NULL;
+
+  if (libys != NULL) return 0;
+
+#ifdef _WIN32
+  snprintf(name, sizeof(name), "libys.dll");
+  (void)version;
+#elif defined(__APPLE__)
+  snprintf(name, sizeof(name), "libys.dylib.%s", version);
+#else
+  snprintf(name, sizeof(name), "libys.so.%s", version);
+#endif
+
+  if (path != NULL && *path != '\0') lib = lib_open(path);
+  if (lib == NULL && find_libys(name, found, sizeof(found))) {
+    lib = lib_open(found);
+  }
+  // Last, let the system loader search its own paths:
+  if (lib == NULL) lib = lib_open(name);
+
+  if (lib == NULL) {
+    snprintf(load_error, sizeof(load_error),
+      "Shared library file '%s' not found\n"
+      "Try: curl https://yamlscript.org/install |"
+      " VERSION=%s LIB=1 bash\n"
+      "See: https://github.com/yaml/yamlscript/wiki/"
+      "Installing-YAMLScript",
+      name, version);
+    return -1;
+  }
+
+  create_isolate =
+    (create_isolate_fn)lib_sym(lib, "graal_create_isolate");
+  attach_thread =
+    (attach_thread_fn)lib_sym(lib, "graal_attach_thread");
+  detach_thread =
+    (isolate_thread_fn)lib_sym(lib, "graal_detach_thread");
+  tear_down_isolate =
+    (isolate_thread_fn)lib_sym(lib, "graal_tear_down_isolate");
+  detach_all_and_tear_down = (isolate_thread_fn)lib_sym(lib,
+    "graal_detach_all_threads_and_tear_down_isolate");
+  load_ys_to_json =
+    (load_ys_to_json_fn)lib_sym(lib, "load_ys_to_json");
+  load_ys_to_json_into =
+    (load_ys_to_json_into_fn)lib_sym(lib, "load_ys_to_json_into");
+  load_ys_batch_to_json =
+    (load_ys_batch_to_json_fn)lib_sym(lib, "load_ys_batch_to_json");
+  load_ys_file_to_json =
+    (load_ys_file_to_json_fn)lib_sym(lib, "load_ys_file_to_json");
+  load_ys_buffer_to_json =
+    (load_ys_buffer_to_json_fn)lib_sym(lib, "load_ys_buffer_to_json");
+  load_ys_to_cbor =
+    (load_ys_to_cbor_fn)lib_sym(lib, "load_ys_to_cbor");
+  ys_compile = (ys_compile_fn)lib_sym(lib, "ys_compile");
+  ys_eval = (ys_eval_fn)lib_sym(lib, "ys_eval");
+  ys_release = (ys_release_fn)lib_sym(lib, "ys_release");
+
+  if (create_isolate == NULL || attach_thread == NULL ||
+      tear_down_isolate == NULL || load_ys_to_json == NULL) {
+    snprintf(load_error, sizeof(load_error),
+      "Required symbols not found in libys");
+    return -1;
+  }
+
+  libys = lib;
+  return 0;
+}
+
+static void init_open_lock(void) {
+  mutex_init(&open_lock);
+}
+
+int ys_ffi_open(const char *version, const char *path) {
+  int rc;
+
+  run_once(&open_once, init_open_lock);
+  mutex_lock(&open_lock);
+  rc = open_libys(version, path);
+  mutex_unlock(&open_lock);
+  return rc;
+}
+
+const char *ys_ffi_error(void) {
+  return load_error;
+}
+
+//------------------------------------------------------------------------------
+// Isolate pool
+//------------------------------------------------------------------------------
+
+// Detach an exiting OS thread from the isolate it was using:
+static void detach_on_exit(void *thread) {
+  if (detach_thread != NULL) detach_thread(thread);
+}
+
+ys_ffi_pool *ys_ffi_pool_create(int size) {
+  ys_ffi_pool *pool = calloc(1, sizeof(ys_ffi_pool));
+
+  if (pool == NULL) return NULL;
+  pool->version = POOL_VERSION;
+  pool->size = size > 0 ? size : 0;
+  pool->isolates = calloc(pool->size + 1, sizeof(void *));
+  pool->threads = calloc(pool->size + 1, sizeof(void *));
+  pool->owners = calloc(pool->size + 1, sizeof(ffi_thread_id));
+  if (pool->isolates == NULL || pool->threads == NULL ||
+      pool->owners == NULL ||
+      key_create(&pool->key, detach_on_exit) != 0) {
+    free(pool->isolates);
+    free(pool->threads);
+    free(pool->owners);
+    free(pool);
+    return NULL;
+  }
+  mutex_init(&pool->lock);
+  mutex_init(&pool->eval_lock);
+  return pool;
+}
+
+// Callers stay attached to their isolates, so each one is torn down
+// from a thread attached here just for that purpose:
+void ys_ffi_pool_destroy(ys_ffi_pool *pool) {
+  int i;
+
+  if (pool == NULL || pool == shared_pool) return;
+  mutex_lock(&pool->lock);
+  pool->closing = pool->programs > 0;
+  mutex_unlock(&pool->lock);
+  if (pool->closing) return;
+  // No exiting thread may detach from an isolate being torn down:
+  key_delete(pool->key);
+  for (i = 0; libys != NULL && i < pool->used; i++) {
+    void *thread = NULL;
+    if (pool->isolates[i] == NULL) continue;
+    if (attach_thread(pool->isolates[i], &thread) != 0) continue;
+    if (detach_all_and_tear_down != NULL) {
+      detach_all_and_tear_down(thread);
+    } else {
+      tear_down_isolate(thread);
+    }
+  }
+  // Queued handles went with their isolates:
+  while (pool->releases != NULL) {
+    struct release *next = pool->releases->next;
+    free(pool->releases);
+    pool->releases = next;
+  }
+  mutex_destroy(&pool->lock);
+  mutex_destroy(&pool->eval_lock);
+  free(pool->isolates);
+  free(pool->threads);
+  free(pool->owners);
+  free(pool);
+}
+
+// The old pool's key runs the old library's detach_on_exit when a
+// thread exits, and that code goes away with the old library. Swap in
+// a key of this library's own. The threads that had a value under the
+// old key find their isolates again by owner (see ys_ffi_pool_thread):
+ys_ffi_pool *ys_ffi_pool_adopt(void *old) {
+  ys_ffi_pool *pool = old;
+  ffi_key key;
+
+  if (pool == NULL || pool->version != POOL_VERSION) return NULL;
+  if (key_create(&key, detach_on_exit) != 0) return NULL;
+  mutex_lock(&pool->lock);
+  key_delete(pool->key);
+  pool->key = key;
+  mutex_unlock(&pool->lock);
+  return pool;
+}
+
+// Return the slot of the isolate the calling OS thread created, or -1.
+// Called with the pool locked:
+static int owned_slot(ys_ffi_pool *pool) {
+  ffi_thread_id self = thread_self();
+  int i;
+
+  for (i = 0; i < pool->used; i++) {
+    if (pool->isolates[i] != NULL && thread_equal(pool->owners[i], self)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void *ys_ffi_pool_thread(ys_ffi_pool *pool) {
+  void *thread;
+  void *isolate = NULL;
+  int slot;
+
+  if (pool == NULL || libys == NULL) return NULL;
+
+  thread = key_get(pool->key);
+  if (thread != NULL) return thread;
+
+  mutex_lock(&pool->lock);
+  if (pool->shared && pool->used > 0) {
+    if (attach_thread(pool->isolates[0], &thread) != 0) thread = NULL;
+  } else if ((slot = owned_slot(pool)) >= 0) {
+    // Attaching again returns the thread's isolate thread, or a new
+    // one if the owner has exited and its thread id was reused:
+    if (attach_thread(pool->isolates[slot], &thread) != 0) {
+      thread = NULL;
+    } else {
+      pool->threads[slot] = thread;
+    }
+  } else if (pool->used < pool->size &&
+      create_isolate(NULL, &isolate, &thread) == 0) {
+    pool->threads[pool->used] = thread;
+    pool->owners[pool->used] = thread_self();
+    pool->isolates[pool->used++] = isolate;
+  } else {
+    thread = NULL;
+  }
+  if (thread != NULL) key_set(pool->key, thread);
+  mutex_unlock(&pool->lock);
+
+  return thread;
+}
+
+static void create_shared_pool(void) {
+  shared_pool = ys_ffi_pool_create(1);
+  if (shared_pool != NULL) shared_pool->shared = 1;
+}
+
+ys_ffi_pool *ys_ffi_shared_pool(void) {
+  run_once(&shared_once, create_shared_pool);
+  return shared_pool;
+}
+
+void ys_ffi_pool_release(ys_ffi_pool *pool) {
+  void *thread;
+
+  // A pool's own isolates are only let go of by ys_ffi_pool_destroy:
+  if (pool == NULL || !pool->shared) return;
+  thread = key_get(pool->key);
+  if (thread == NULL) return;
+  key_set(pool->key, NULL);
+  if (detach_thread != NULL) detach_thread(thread);
+}
+
+//------------------------------------------------------------------------------
+// Results
+//------------------------------------------------------------------------------
+
+// Copy len bytes into memory from alloc (or malloc, NUL terminated):
+static char *copy_result(
+  const char *text, size_t len,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *out_len
+) {
+  char *buffer = alloc != NULL ? alloc(ctx, len) : malloc(len + 1);
+
+  if (buffer == NULL) return NULL;
+  memcpy(buffer, text, len);
+  if (alloc == NULL) buffer[len] = '\0';
+  if (out_len != NULL) *out_len = len;
+  return buffer;
+}
+
+char *ys_ffi_error_json(
+  const char *cause, ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  char json[2048];
+  size_t i = 0;
+  const char *c;
+
+  i += snprintf(json, sizeof(json), "{\"error\":{\"cause\":\"");
+  // Escape the cause as a JSON string, leaving room for the tail:
+  for (c = cause; *c != '\0' && i < sizeof(json) - 16; c++) {
+    unsigned char ch = (unsigned char)*c;
+    if (ch == '"' || ch == '\\') {
+      json[i++] = '\\';
+      json[i++] = ch;
+    } else if (ch == '\n') {
+      json[i++] = '\\';
+      json[i++] = 'n';
+    } else if (ch < 0x20) {
+      i += snprintf(json + i, sizeof(json) - i, "\\u%04x", ch);
+    } else {
+      json[i++] = ch;
+    }
+  }
+  i += snprintf(json + i, sizeof(json) - i, "\"}}");
+
+  return copy_result(json, i, alloc, ctx, len);
+}
+
+char *ys_ffi_error_cbor(
+  const char *cause, ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  // {"error": {"cause": ...}} up to the cause string's head:
+  static const char head[] = "\xa1\x65" "error" "\xa1\x65" "cause";
+  unsigned char cbor[2048];
+  size_t size = strlen(cause);
+  size_t i = sizeof(head) - 1;
+
+  if (size > sizeof(cbor) - i - 3) size = sizeof(cbor) - i - 3;
+  memcpy(cbor, head, i);
+  if (size < 24) {
+    cbor[i++] = 0x60 | size;
+  } else if (size < 0x100) {
+    cbor[i++] = 0x78;
+    cbor[i++] = size;
+  } else {
+    cbor[i++] = 0x79;
+    cbor[i++] = size >> 8;
+    cbor[i++] = size & 0xff;
+  }
+  memcpy(cbor + i, cause, size);
+
+  return copy_result((char *)cbor, i + size, alloc, ctx, len);
+}
+
+// A load request: one input (NUL terminated, or data of length bytes),
+// a batch of count inputs (of lengths bytes each, or NUL terminated if
+// lengths is NULL), a file path or a compiled program to eval
+// with opts. cbor asks for a CBOR rather than a JSON response (for
+// data only). handle is the program's handle in the isolate in use:
+struct request {
+  const char *input;
+  const char *const *inputs;
+  const long long *lengths;
+  int count;
+  const char *path;
+  const char *data;
+  size_t length;
+  int cbor;
+  ys_ffi_program *program;
+  const char *opts;
+  long long handle;
+};
+
+// Format an error response in the format the request asked for:
+static char *error_response(
+  const struct request *req, const char *cause,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  if (req->cbor) return ys_ffi_error_cbor(cause, alloc, ctx, len);
+  return ys_ffi_error_json(cause, alloc, ctx, len);
+}
+
+// Return the name of the libys entry point req needs, if libys does
+// not have it:
+static const char *missing_entry_point(const struct request *req) {
+  if (req->inputs != NULL && load_ys_batch_to_json == NULL) {
+    return "load_ys_batch_to_json";
+  }
+  if (req->path != NULL && load_ys_file_to_json == NULL) {
+    return "load_ys_file_to_json";
+  }
+  if (req->cbor && load_ys_to_cbor == NULL) {
+    return "load_ys_to_cbor";
+  }
+  if (req->data != NULL && !req->cbor && load_ys_buffer_to_json == NULL) {
+    return "load_ys_buffer_to_json";
+  }
+  if (req->program != NULL &&
+      (ys_compile == NULL || ys_eval == NULL || ys_release == NULL)) {
+    return "ys_compile";
+  }
+  return NULL;
+}
+
+// Call the libys entry point for req. With fetch set, the response
+// libys kept for this thread is fetched instead:
+static long long request_into(
+  void *thread, const struct request *req, int fetch,
+  char *buffer, long long size
+) {
+  if (req->program != NULL) {
+    return ys_eval(
+      thread, fetch ? 0 : req->handle, req->opts, buffer, size);
+  }
+  if (req->inputs != NULL) {
+    return load_ys_batch_to_json(
+      thread, fetch ? NULL : req->inputs, req->lengths, req->count,
+      buffer, size);
+  }
+  if (req->path != NULL) {
+    return load_ys_file_to_json(
+      thread, fetch ? NULL : req->path, buffer, size);
+  }
+  if (req->data != NULL) {
+    return (req->cbor ? load_ys_to_cbor : load_ys_buffer_to_json)(
+      thread, fetch ? NULL : req->data, (long long)req->length,
+      buffer, size);
+  }
+  return load_ys_to_json_into(
+    thread, fetch ? NULL : req->input, buffer, size);
+}
+
+// Have libys write the response straight into memory from alloc: the
+// first call evaluates and returns the length, the second copies the
+// response that libys kept for this thread:
+static char *load_into(
+  void *thread, const struct request *req,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *out_len
+) {
+  long long len = request_into(thread, req, 0, NULL, 0);
+  char *buffer;
+
+  if (len < 0) {
+    return error_response(
+      req, "Bad response from libys", alloc, ctx, out_len);
+  }
+
+  buffer = alloc != NULL ?
+    alloc(ctx, (size_t)len) : malloc((size_t)len + 1);
+  // libys drops the kept response on the next call:
+  if (buffer == NULL) return NULL;
+
+  if (request_into(
+        thread, req, 1, buffer, alloc != NULL ? len : len + 1) != len) {
+    if (alloc == NULL) free(buffer);
+    return error_response(
+      req, "Bad response from libys", alloc, ctx, out_len);
+  }
+
+  if (out_len != NULL) *out_len = (size_t)len;
+  return buffer;
+}
+
+//------------------------------------------------------------------------------
+// Compiled programs
+//------------------------------------------------------------------------------
+
+// Return the index of the isolate thread belongs to in pool, or -1.
+// Every thread in a shared pool uses its one isolate. Called with the
+// pool locked:
+static int find_slot(ys_ffi_pool *pool, void *thread) {
+  int slot = -1;
+  int i;
+
+  if (pool->shared) return 0;
+  for (i = 0; i < pool->used; i++) {
+    if (pool->threads[i] == thread) slot = i;
+  }
+  return slot;
+}
+
+static int pool_slot(ys_ffi_pool *pool, void *thread) {
+  int slot;
+
+  mutex_lock(&pool->lock);
+  slot = find_slot(pool, thread);
+  mutex_unlock(&pool->lock);
+  return slot;
+}
+
+// Release the handles queued for the isolate of a pooled thread (see
+// release_handles). Called by every pooled request, before its own
+// work, so a handle waits at most until its isolate's next use:
+static void run_releases(ys_ffi_pool *pool, void *thread) {
+  struct release **link;
+  struct release *mine = NULL;
+  int slot;
+
+  mutex_lock(&pool->lock);
+  if (pool->releases != NULL) {
+    slot = find_slot(pool, thread);
+    link = &pool->releases;
+    while (*link != NULL) {
+      struct release *release = *link;
+      if (release->slot == slot) {
+        *link = release->next;
+        release->next = mine;
+        mine = release;
+      } else {
+        link = &release->next;
+      }
+    }
+  }
+  mutex_unlock(&pool->lock);
+
+  while (mine != NULL) {
+    struct release *next = mine->next;
+    ys_release(thread, mine->handle);
+    free(mine);
+    mine = next;
+  }
+}
+
+// Return the program's handle in the isolate of a pooled thread,
+// compiling it there on first use. 0 if thread is not in the pool:
+static long long program_handle(ys_ffi_program *program, void *thread) {
+  int slot = pool_slot(program->pool, thread);
+  long long handle;
+
+  if (slot < 0) return 0;
+  mutex_lock(&program->lock);
+  handle = program->handles[slot];
+  if (handle == 0) {
+    handle = program->handles[slot] =
+      ys_compile(thread, program->source);
+  }
+  mutex_unlock(&program->lock);
+  return handle;
+}
+
+ys_ffi_program *ys_ffi_compile(
+  ys_ffi_pool *pool, const char *input, size_t length
+) {
+  ys_ffi_program *program = calloc(1, sizeof(ys_ffi_program));
+  int slots = pool == NULL ? 0 : pool->shared ? 1 : pool->size;
+  void *thread;
+
+  if (program == NULL) return NULL;
+  program->source = malloc(length + 1);
+  program->handles = calloc(slots + 1, sizeof(long long));
+  if (program->source == NULL || program->handles == NULL) {
+    free(program->source);
+    free(program->handles);
+    free(program);
+    return NULL;
+  }
+  memcpy(program->source, input, length);
+  program->source[length] = '\0';
+  program->pool = pool;
+  mutex_init(&program->lock);
+
+  if (pool != NULL) {
+    mutex_lock(&pool->lock);
+    pool->programs++;
+    mutex_unlock(&pool->lock);
+  }
+
+  // Compile in the caller's isolate now, so a program that is only
+  // ever used from this thread never compiles on an eval:
+  if (libys != NULL && ys_compile != NULL &&
+      (thread = ys_ffi_pool_thread(pool)) != NULL) {
+    if (pool->shared) mutex_lock(&pool->eval_lock);
+    if (ys_release != NULL) run_releases(pool, thread);
+    program_handle(program, thread);
+    if (pool->shared) mutex_unlock(&pool->eval_lock);
+  }
+
+  return program;
+}
+
+// Release the program's handle in the isolate of each slot. Programs
+// are often released from garbage collector or scheduler threads, which
+// must not attach to (and maybe wait on) other threads' isolates. The
+// caller's own isolate releases its handle now, and the others are
+// queued for the next request in their isolate (see run_releases). A
+// handle that can not be queued is left for its isolate's tear down:
+static void release_handles(ys_ffi_program *program) {
+  ys_ffi_pool *pool = program->pool;
+  void *own = key_get(pool->key);
+  int own_slot = own != NULL ? pool_slot(pool, own) : -1;
+  int slots = pool->shared ? 1 : pool->used;
+  int i;
+
+  for (i = 0; i < slots; i++) {
+    struct release *release;
+    if (program->handles[i] == 0) continue;
+    if (i == own_slot) {
+      if (pool->shared) mutex_lock(&pool->eval_lock);
+      ys_release(own, program->handles[i]);
+      if (pool->shared) mutex_unlock(&pool->eval_lock);
+    } else if ((release = malloc(sizeof(struct release))) != NULL) {
+      release->slot = i;
+      release->handle = program->handles[i];
+      mutex_lock(&pool->lock);
+      release->next = pool->releases;
+      pool->releases = release;
+      mutex_unlock(&pool->lock);
+    }
+  }
+}
+
+void ys_ffi_release(ys_ffi_program *program) {
+  ys_ffi_pool *pool;
+  int destroy = 0;
+
+  if (program == NULL) return;
+  pool = program->pool;
+
+  if (pool != NULL) {
+    if (libys != NULL && ys_release != NULL) release_handles(program);
+    mutex_lock(&pool->lock);
+    pool->programs--;
+    destroy = pool->closing && pool->programs == 0;
+    mutex_unlock(&pool->lock);
+  }
+
+  mutex_destroy(&program->lock);
+  free(program->handles);
+  free(program->source);
+  free(program);
+
+  if (destroy) ys_ffi_pool_destroy(pool);
+}
+
+//------------------------------------------------------------------------------
+// Loading
+//------------------------------------------------------------------------------
+
+static char *load_request(
+  ys_ffi_pool *pool, struct request *req,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  void *isolate = NULL;
+  void *thread;
+  const char *json;
+  const char *missing;
+  char *result;
+  int pooled;
+  int serial;
+
+  if (libys == NULL) {
+    return error_response(req, load_error, alloc, ctx, len);
+  }
+  if ((missing = missing_entry_point(req)) != NULL) {
+    char cause[256];
+    snprintf(cause, sizeof(cause), "%s not found in libys", missing);
+    return error_response(req, cause, alloc, ctx, len);
+  }
+
+  // Use the caller's pooled isolate, or fall back to a one-off isolate
+  // when the pool has no slot for this thread:
+  thread = ys_ffi_pool_thread(pool);
+  pooled = thread != NULL;
+  if (!pooled && create_isolate(NULL, &isolate, &thread) != 0) {
+    return error_response(
+      req, "Failed to create isolate", alloc, ctx, len);
+  }
+
+  // The threads attached to a shared pool's one isolate take turns.
+  // Some YS runtime state (like the options and the environment) is
+  // still process wide, so evaluations in one heap must not overlap:
+  serial = pooled && pool->shared;
+  if (serial) mutex_lock(&pool->eval_lock);
+  if (pooled && ys_release != NULL) run_releases(pool, thread);
+
+  // A program is compiled once per pooled isolate, but in every
+  // one-off isolate:
+  if (req->program != NULL) {
+    req->handle = pooled ? program_handle(req->program, thread) : 0;
+    if (req->handle == 0) {
+      req->handle = ys_compile(thread, req->program->source);
+    }
+  }
+
+  if (req->inputs != NULL || req->path != NULL || req->data != NULL ||
+      req->program != NULL || load_ys_to_json_into != NULL) {
+    result = load_into(thread, req, alloc, ctx, len);
+  } else if ((json = load_ys_to_json(thread, req->input)) == NULL) {
+    result = ys_ffi_error_json(
+      "Null response from libys", alloc, ctx, len);
+  } else {
+    result = copy_result(json, strlen(json), alloc, ctx, len);
+  }
+
+  if (serial) mutex_unlock(&pool->eval_lock);
+  if (!pooled) tear_down_isolate(thread);
+
+  return result;
+}
+
+char *ys_ffi_load_json(
+  ys_ffi_pool *pool, const char *input,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  struct request req = {
+    input, NULL, NULL, 0, NULL, NULL, 0, 0, NULL, NULL, 0 };
+
+  return load_request(pool, &req, alloc, ctx, len);
+}
+
+char *ys_ffi_load_batch_json(
+  ys_ffi_pool *pool, const char *const *inputs, const long long *lengths,
+  int count, ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  // libys takes a NULL inputs to mean "fetch", so never pass one:
+  static const char *const none[1] = { NULL };
+  struct request req = {
+    NULL, inputs != NULL ? inputs : none, lengths, count, NULL, NULL, 0,
+    0, NULL, NULL, 0 };
+
+  return load_request(pool, &req, alloc, ctx, len);
+}
+
+char *ys_ffi_load_file_json(
+  ys_ffi_pool *pool, const char *path,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  struct request req = {
+    NULL, NULL, NULL, 0, path, NULL, 0, 0, NULL, NULL, 0 };
+
+  if (path == NULL) {
+    return ys_ffi_error_json("No file path given", alloc, ctx, len);
+  }
+  return load_request(pool, &req, alloc, ctx, len);
+}
+
+char *ys_ffi_load_buffer_json(
+  ys_ffi_pool *pool, const char *input, size_t length,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  // libys takes a NULL input to mean "fetch", so never pass one:
+  struct request req = {
+    NULL, NULL, NULL, 0, NULL, input != NULL ? input : "", length, 0,
+    NULL, NULL, 0 };
+
+  return load_request(pool, &req, alloc, ctx, len);
+}
+
+char *ys_ffi_load_cbor(
+  ys_ffi_pool *pool, const char *input, size_t length,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  struct request req = {
+    NULL, NULL, NULL, 0, NULL, input != NULL ? input : "", length, 1,
+    NULL, NULL, 0 };
+
+  return load_request(pool, &req, alloc, ctx, len);
+}
+
+char *ys_ffi_eval_json(
+  ys_ffi_program *program, const char *opts,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len
+) {
+  struct request req = {
+    NULL, NULL, NULL, 0, NULL, NULL, 0, 0, program, opts, 0 };
+
+  if (program == NULL) {
+    return ys_ffi_error_json("No program given", alloc, ctx, len);
+  }
+  return load_request(program->pool, &req, alloc, ctx, len);
+}
+
+//------------------------------------------------------------------------------
+// CBOR reading
+//------------------------------------------------------------------------------
+
+int ys_ffi_cbor_head(
+  const unsigned char **p, const unsigned char *end,
+  int *major, int *info, unsigned long long *arg
+) {
+  const unsigned char *c = *p;
+  int size;
+
+  if (c >= end) return -1;
+  *major = *c >> 5;
+  *info = *c & 0x1f;
+  c++;
+
+  if (*info < 24) {
+    *arg = *info;
+    *p = c;
+    return 0;
+  }
+  // 25-27 are 2, 4 and 8 byte arguments; 28-31 are reserved or
+  // indefinite lengths, which libys never writes:
+  if (*info > 27) return -1;
+  size = 1 << (*info - 24);
+  if (end - c < size) return -1;
+
+  *arg = 0;
+  while (size-- > 0) *arg = (*arg << 8) | *c++;
+  *p = c;
+  return 0;
+}
+
+double ys_ffi_cbor_float(int info, unsigned long long arg) {
+  if (info == 27) {
+    double d;
+    memcpy(&d, &arg, sizeof(d));
+    return d;
+  }
+  if (info == 26) {
+    unsigned int bits = (unsigned int)arg;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  // A half precision float, widened to a double bit by bit (so no
+  // libm is needed):
+  {
+    unsigned long long bits = (arg & 0x8000) << 48;
+    unsigned long long exp = (arg >> 10) & 0x1f;
+    unsigned long long mant = arg & 0x3ff;
+    double d;
+    if (exp == 0) {
+      d = mant / 16777216.0;
+      return (arg & 0x8000) ? -d : d;
+    }
+    bits |= (exp == 31 ? 0x7ff : exp - 15 + 1023) << 52;
+    bits |= mant << 42;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+}
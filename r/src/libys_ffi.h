@@ -0,0 +1,156 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// libys-ffi is the C helper library shared by the bindings that reach
+// libys through a small C shim (elixir, erlang, r, prolog, common-lisp,
+// moonbit and dyalog).
+//
+// It owns finding and opening the libys shared library, resolving its
+// symbols, a pool of long-lived GraalVM isolates, formatting error JSON
+// and copying results into memory owned by the host language. Each
+// binding shim is a thin adapter over this API.
+//
+// The sources live in common/libys-ffi/ and common/binding.mk copies
+// them into every binding that uses them, so that each binding package
+// stays self-contained. Edit the common/ copy only.
+
+#ifndef LIBYS_FFI_H
+#define LIBYS_FFI_H
+
+#include <stddef.h>
+
+// Keep the helpers private to the shim library they are built into:
+#if defined(__GNUC__) && !defined(_WIN32)
+#define YS_FFI_API __attribute__((visibility("hidden")))
+#else
+#define YS_FFI_API
+#endif
+
+// A set of long-lived isolates. Each OS thread that calls in claims a
+// slot of its own on first use, so no isolate of a pool is ever
+// entered by two threads at once. The shared pool (see below) is the
+// exception; its threads take turns instead:
+typedef struct ys_ffi_pool ys_ffi_pool;
+
+// A YS program compiled once (see ys_ffi_compile) and evaluated any
+// number of times:
+typedef struct ys_ffi_program ys_ffi_program;
+
+// Return size bytes of host language memory for a result, or NULL:
+typedef char *(*ys_ffi_alloc_fn)(void *ctx, size_t size);
+
+// Find, open and resolve libys for an exact version. path is a library
+// file to try before searching (may be NULL). Returns 0 on success, or
+// -1 with the reason in ys_ffi_error(). Safe to call more than once,
+// and from many threads at once:
+YS_FFI_API int ys_ffi_open(const char *version, const char *path);
+YS_FFI_API const char *ys_ffi_error(void);
+
+// Create a pool with room for size threads. Callers beyond that (or
+// any caller of a size 0 pool) get a one-off isolate per call. A pool
+// with live programs is destroyed when the last one is released:
+YS_FFI_API ys_ffi_pool *ys_ffi_pool_create(int size);
+YS_FFI_API void ys_ffi_pool_destroy(ys_ffi_pool *pool);
+
+// Take over a pool created by another copy of this library (a shim
+// being hot upgraded). The pool's thread key is replaced by one whose
+// exit destructor is in this copy, so the old copy can be unloaded.
+// Returns NULL if its layout is not compatible or no key is left:
+YS_FFI_API ys_ffi_pool *ys_ffi_pool_adopt(void *old);
+
+// Return the isolate thread the calling OS thread owns in pool,
+// creating its isolate (or attaching to the shared one) on first use.
+// NULL if the pool is full:
+YS_FFI_API void *ys_ffi_pool_thread(ys_ffi_pool *pool);
+
+// Return the process-wide shared pool: one isolate, created on first
+// use, that every calling OS thread attaches to with its own isolate
+// thread. Threads detach when they exit. Safe to call from any number
+// of threads at once, but only one evaluates in the isolate at a time.
+// The shared pool is never destroyed:
+YS_FFI_API ys_ffi_pool *ys_ffi_shared_pool(void);
+
+// Detach the calling thread from the shared pool's isolate. Its next
+// call attaches again. Does nothing for other pools:
+YS_FFI_API void ys_ffi_pool_release(ys_ffi_pool *pool);
+
+// Compile and eval a YS string and return the libys JSON response in
+// memory from alloc, setting *len to its byte length. libys writes the
+// UTF-8 response straight into that memory (load_ys_to_json_into), so
+// the response is never copied twice. Failures inside
+// the helper are returned as a libys style error JSON response.
+// With a NULL alloc the result is malloc'd and NUL terminated; free it
+// with free(). Returns NULL only if alloc fails:
+YS_FFI_API char *ys_ffi_load_json(
+  ys_ffi_pool *pool, const char *input,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Like ys_ffi_load_json for length bytes of input, which need not be
+// NUL terminated (like a host language binary or string):
+YS_FFI_API char *ys_ffi_load_buffer_json(
+  ys_ffi_pool *pool, const char *input, size_t length,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Like ys_ffi_load_json for count inputs in one libys call. Input i is
+// lengths[i] bytes, which need not be NUL terminated, or a NUL
+// terminated string if lengths is NULL. The result is a JSON array of
+// response objects, one per input, in input order:
+YS_FFI_API char *ys_ffi_load_batch_json(
+  ys_ffi_pool *pool, const char *const *inputs, const long long *lengths,
+  int count, ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Like ys_ffi_load_json for the YS file at path. libys maps the file
+// and parses it as it reads, so the caller never reads it into memory:
+YS_FFI_API char *ys_ffi_load_file_json(
+  ys_ffi_pool *pool, const char *path,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Like ys_ffi_load_buffer_json, but the response is encoded as CBOR
+// (RFC 8949) instead of JSON. Decode it with the readers below:
+YS_FFI_API char *ys_ffi_load_cbor(
+  ys_ffi_pool *pool, const char *input, size_t length,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Compile length bytes of YS code for evaluating with
+// ys_ffi_eval_json. libys keeps the compiled forms in each of the
+// pool's isolates that evaluates it (compiling it there on first use,
+// starting with the caller's), so evaluations skip parsing and
+// compiling. Compile errors are returned by each evaluation. Release
+// with ys_ffi_release. Returns NULL if no memory is left:
+YS_FFI_API ys_ffi_program *ys_ffi_compile(
+  ys_ffi_pool *pool, const char *input, size_t length);
+
+// Evaluate a compiled program and return the JSON response, allocated
+// like the ys_ffi_load_json result. opts is NULL or a JSON object with
+// optional "args" (an array of strings) and "env" (an object of
+// strings merged over the process environment):
+YS_FFI_API char *ys_ffi_eval_json(
+  ys_ffi_program *program, const char *opts,
+  ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Free a program. Its compiled forms are freed now in the caller's
+// own isolate, and in each other isolate by the next call that uses
+// it, so any thread (like a garbage collector's) may release:
+YS_FFI_API void ys_ffi_release(ys_ffi_program *program);
+
+// Format {"error":{"cause":...}} for cause, allocated like the
+// ys_ffi_load_json result:
+YS_FFI_API char *ys_ffi_error_json(
+  const char *cause, ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// The same error response, encoded as CBOR:
+YS_FFI_API char *ys_ffi_error_cbor(
+  const char *cause, ys_ffi_alloc_fn alloc, void *ctx, size_t *len);
+
+// Read the head of the CBOR data item at *p and move *p past it. Sets
+// *major to the major type (0-7), *info to the additional info and
+// *arg to the argument (a count, length, value, tag or raw float
+// bits). Returns 0, or -1 for truncated or indefinite length items:
+YS_FFI_API int ys_ffi_cbor_head(
+  const unsigned char **p, const unsigned char *end,
+  int *major, int *info, unsigned long long *arg);
+
+// Return the value of a major type 7 float head (info 25, 26 or 27):
+YS_FFI_API double ys_ffi_cbor_float(int info, unsigned long long arg);
+
+#endif
@@ -0,0 +1,164 @@
+// Copyright 2023-2026 Ingy dot Net
+// This code is licensed under MIT license (See License for details)
+
+// ys-client runs a ys command line in a resident `ys --server SOCKET`
+// process, so that it doesn't pay ys startup:
+//
+//   ys --server /tmp/ys.sock &
+//   YS_SERVER=/tmp/ys.sock ys-client -l file.ys
+//
+// It takes the same options and args as ys. It sends them to the server
+// along with its environment, working directory and pid, copies the run's
+// output to its stdout and stderr, and exits with the run's exit status. Its
+// stdin is only read if the run reads stdin.
+//
+// See ys/src/yamlscript/server.clj for the protocol.
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static void die(const char *msg) {
+  fprintf(stderr, "ys-client: %s\n", msg);
+  exit(1);
+}
+
+static void write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      die(strerror(errno));
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+// Read exactly len bytes. Returns 0, or -1 at end of input:
+static int read_all(int fd, void *buf, size_t len) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      die(strerror(errno));
+    }
+    if (n == 0) return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static void send_frame(int fd, char tag, const char *data, size_t len) {
+  unsigned char head[5] = {
+    (unsigned char)tag,
+    (unsigned char)(len >> 24), (unsigned char)(len >> 16),
+    (unsigned char)(len >> 8), (unsigned char)len};
+  write_all(fd, head, sizeof(head));
+  if (len > 0) write_all(fd, data, len);
+}
+
+static void send_string(int fd, char tag, const char *s) {
+  send_frame(fd, tag, s, strlen(s));
+}
+
+static int connect_server(const char *path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path))
+    die("YS_SERVER socket path is too long");
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) die(strerror(errno));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "ys-client: Can't connect to '%s': %s\n",
+      path, strerror(errno));
+    exit(1);
+  }
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  const char *path = getenv("YS_SERVER");
+  if (path == NULL || *path == '\0')
+    die("Set YS_SERVER to the socket of a 'ys --server SOCKET' process");
+
+  int fd = connect_server(path);
+
+  for (int i = 1; i < argc; i++) send_string(fd, 'a', argv[i]);
+  for (char **env = environ; *env != NULL; env++)
+    send_string(fd, 'v', *env);
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) != NULL) send_string(fd, 'd', cwd);
+  char pid[24];
+  snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+  send_string(fd, 'p', pid);
+  send_frame(fd, 'r', NULL, 0);
+
+  static char buf[65536];
+  int stdin_open = 0;
+  for (;;) {
+    struct pollfd fds[2] = {
+      {.fd = fd, .events = POLLIN},
+      {.fd = STDIN_FILENO, .events = POLLIN}};
+    if (poll(fds, stdin_open ? 2 : 1, -1) < 0) {
+      if (errno == EINTR) continue;
+      die(strerror(errno));
+    }
+
+    if (stdin_open && (fds[1].revents & (POLLIN | POLLHUP))) {
+      ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        send_frame(fd, 'i', NULL, 0);
+        stdin_open = 0;
+      } else {
+        send_frame(fd, 'i', buf, n);
+      }
+    }
+
+    if (!(fds[0].revents & (POLLIN | POLLHUP))) continue;
+
+    unsigned char head[5];
+    if (read_all(fd, head, sizeof(head)) < 0)
+      die("The server closed the connection");
+    uint32_t len = (uint32_t)head[1] << 24 | (uint32_t)head[2] << 16 |
+      (uint32_t)head[3] << 8 | head[4];
+    char *data = len > sizeof(buf) ? malloc(len) : buf;
+    if (data == NULL) die("Out of memory");
+    if (read_all(fd, data, len) < 0)
+      die("The server closed the connection");
+
+    switch (head[0]) {
+      case 'o':
+        write_all(STDOUT_FILENO, data, len);
+        break;
+      case 'e':
+        write_all(STDERR_FILENO, data, len);
+        break;
+      case 'i':
+        stdin_open = 1;
+        break;
+      case 'x': {
+        char status[16] = {0};
+        memcpy(status, data, len < 15 ? len : 15);
+        return atoi(status);
+      }
+      default:
+        die("Bad frame from the server");
+    }
+    if (data != buf) free(data);
+  }
+}
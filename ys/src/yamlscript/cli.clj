@@ -20,9 +20,12 @@
    [clojure.tools.cli :as cli]
    [ys.v0.common]
    [ys.v0.global :refer [env]]
+   [yamlscript.cache :as cache]
    [yamlscript.compiler :as compiler]
    [yamlscript.global :as global]
-   [yamlscript.runtime :as runtime])
+   [yamlscript.profile :as profile]
+   [yamlscript.runtime :as runtime]
+   [yamlscript.server :as server])
   (:refer-clojure))
 
 (def yamlscript-version "0.2.31")
@@ -37,9 +40,10 @@
     (.getStackTrace (Thread/currentThread))))
 
 (defn exit [n]
-  (if (or (in-repl) @testing)
-    (str "*** exit " n " ***")
-    (System/exit n)))
+  (cond
+    (or (in-repl) @testing) (str "*** exit " n " ***")
+    server/*serving* (server/exit n)
+    :else (System/exit n)))
 
 (defn err [e]
   (let [prefix @global/error-msg-prefix
@@ -49,7 +53,7 @@
     (global/reset-error-msg-prefix!)
     (binding [*out* *err*]
       (print prefix)
-      (if (and (:stack-trace @global/opts) (instance? Throwable e))
+      (if (and (:stack-trace @ys.v0.global/opts) (instance? Throwable e))
         (do
           (clojure.stacktrace/print-stack-trace e)
           (flush))
@@ -149,11 +153,20 @@
      (str "must be one of: "
        (str/join ", " (keys stages))
        " or all")]]
+   [nil "--profile FORMAT"
+    "Print each stage's time, allocation and size
+                           to stderr in FORMAT: json"
+    :validate
+    [#(contains? profile/formats %1)
+     "must be: json"]]
    ["-S" "--stack-trace"
     "Print full stack trace for errors"]
    ["-x" "--xtrace"
     "Print each expression before evaluation"]
 
+   [nil "--server SOCKET"
+    "Serve ys runs from ys-client on a Unix socket"]
+
    [nil "--install"
     "Install the libys shared library"]
    [nil "--upgrade"
@@ -235,6 +248,7 @@ Options:
         ;; Insert blank lines in help text
         help (str/replace help #"\n  (-[cmpTd])" "\n\n  $1")
         help (str/replace help #"\n  (.*--version)" "\n\n  $1")
+        help (str/replace help #"\n  (.*--server)" "\n\n  $1")
         help (str/replace help #"\n  (.*--install)" "\n\n  $1")
         help (str/replace help #"    ([A-Z])" #(second %1))]
     (println help)))
@@ -276,7 +290,7 @@ Options:
                  (str
                    (if (= "-" file)
                      (slurp *in*)
-                     (slurp file))
+                     (slurp (ys.v0.common/abspath file)))
                    "\n"))
         e-code (when (seq (:eval opts))
                  (str
@@ -309,22 +323,49 @@ Options:
         file (or file "NO-NAME")]
     [code file (:load opts)]))
 
-(defn compile-code [code opts]
+(defn compile-code [code opts & [forms]]
   (if (:clojure opts)
     code
     (try
-      (if (seq (:debug-stage opts))
-        (compiler/compile-with-options code)
-        (compiler/compile code))
+      (let [clj (cond
+                  (seq (:debug-stage opts))
+                  (compiler/compile-with-options code)
+                  ,
+                  forms (compiler/compile-forms code)
+                  :else (compiler/compile code))]
+        (when (System/getenv "YS_SHOW_COMPILE_CACHE")
+          (binding [*out* *err*]
+            (println "Compile cache:" (pr-str @cache/compile-stats))))
+        clj)
       (catch Exception e
         (global/reset-error-msg-prefix! "Compile error: ")
         (err e)))))
 
+(defn write-profile
+  "Print the profile of this run to stderr when --profile is used."
+  []
+  (when-let [profile profile/*profile*]
+    (binding [*out* *err*]
+      (println (profile/json @profile)))))
+
 (defn get-compiled-code [opts]
   (let [[code file load] (get-code opts)
         code (if code (compile-code code opts) "")]
     [code file load]))
 
+(defn get-compiled-forms
+  "Like get-compiled-code, but compile YS to Clojure forms (see
+  compiler/compile-forms) when only running the code, so that it is never
+  printed as Clojure text and read back."
+  [opts]
+  (if (or (:clojure opts)
+        (seq (:debug-stage opts))
+        (env "YS_SHOW_COMPILE"))
+    (get-compiled-code opts)
+    (let [[code file load] (get-code opts)
+          forms (if code (compile-code code opts true) [])]
+      [forms file load])))
+
 (def json-options
   {:escape-unicode false
    :escape-js-separators false
@@ -494,46 +535,126 @@ Options:
         clojure (pretty-clojure code)
         clojure (compiled-output opts clojure)]
     (println clojure)
+    (write-profile)
     (when (v0-bb-script? opts)
       (.setExecutable (io/file (:output opts)) true false))
-    (System/exit 0)))
+    (exit 0)))
 
 (def line (str (str/join (repeat 80 "-")) "\n"))
 
+;; YAML output ends with exactly one newline, whatever the last scalar's
+;; chomping (a `|+` string can end with several), like the string that
+;; str/trim-newline leaves, printed with println:
+(defn- trim-newline-writer
+  "Return a Writer over out that holds back trailing newlines, writing them
+  only when more text follows them. Closing it leaves out open."
+  ^java.io.Writer [^java.io.Writer out]
+  (let [held (StringBuilder.)
+        put (fn [^String s]
+              (let [end (loop [i (count s)]
+                          (if (and (pos? i)
+                                (#{\newline \return} (.charAt s (dec i))))
+                            (recur (dec i))
+                            i))]
+                (when (pos? end)
+                  (.write out (str held))
+                  (.setLength held 0)
+                  (.write out s (int 0) (int end)))
+                (.append held (subs s end))))]
+    (proxy [java.io.Writer] []
+      (write
+        ([x]
+         (cond
+           (string? x) (put x)
+           (integer? x) (put (str (char x)))
+           :else (put (String. ^chars x))))
+        ([x off len]
+         (if (string? x)
+           (put (subs x off (+ off len)))
+           (put (String. ^chars x (int off) (int len))))))
+      (flush [] (.flush out))
+      (close []))))
+
+(defn- write-result
+  "Write one result to *out* in a --to format. Each format is written
+  straight to the stream (CSV and TSV a row at a time), not built up as a
+  string first, so large output doesn't need a copy of itself in memory."
+  [result to multi]
+  (case to
+    "yaml" (do
+             (when multi (print "---\n"))
+             (yaml/generate-stream (trim-newline-writer *out*) result
+               :dumper-options {:flow-style :block})
+             (newline))
+    "json" (json/pprint result json-options)
+    "csv"  (do (csv/write-csv *out* result :separator \,) (newline))
+    "tsv"  (do (csv/write-csv *out* result :separator \tab) (newline))
+    "edn"  (pp/pprint result)
+    ,      (do (json/write result *out* json-options) (newline))))
+
+(defn- write-results
+  "Write results of a run (more than one with --stream) to *out*, through a
+  buffer that is flushed once at the end. multi is true when the whole
+  output has more than one result, so each needs a `---` line for YAML."
+  [results to multi]
+  (let [out (java.io.BufferedWriter. ^java.io.Writer *out* 65536)]
+    (try
+      (binding [*out* out
+                *flush-on-newline* false]
+        (run! #(write-result %1 to multi) (remove nil? results)))
+      (finally (.flush out)))))
+
+(defn- stream-writer
+  "Return a fn that writes the --stream values added since its last call,
+  for writing each document's value as soon as it has been evaluated. The
+  first value is held back until a second one shows that the output needs
+  `---` lines, or until the call (with done true) after the run."
+  [to]
+  (let [written (atom 0)]
+    (fn [done]
+      (let [values @ys.v0.global/stream-values
+            n (count values)]
+        (when (and (or done (> n 1)) (> n @written))
+          (write-results (subvec values @written) to (> n 1))
+          (reset! written n))))))
+
+;; A program that calls stream (or uses `+++`) can read and replace the
+;; stream values while it runs, so its output is written after the run:
+(defn- streamable?
+  [code]
+  (not (or (string? code)
+         (re-find #"\bstream\b" (pr-str code)))))
+
 (defn do-run [opts args]
   (try
-    (let [[code file load] (get-compiled-code opts)
-          _ (when (env "YS_SHOW_COMPILE")
-              (eprint (str line (pretty-clojure code) "\n" line)))
-          result (runtime/eval-string code file args)
-          results (if (and (:stream opts) (or load
-                                            (seq (:eval opts))))
-                    @global/stream-values
-                    [result])]
-      (if (:print opts)
-        (pp/pprint result)
-        (when (and load (not (= "" code)))
-          (doall
-            (for [result (remove nil? results)]
-              (case (:to opts)
-                "yaml" (println
-                         (str
-                           (when (> (count results) 1) "---\n")
-                           (str/trim-newline
-                             (yaml/generate-string
-                               result
-                               :dumper-options {:flow-style :block}))))
-                "json" (json/pprint result json-options)
-                "csv"  (println
-                         (with-open [s (java.io.StringWriter.)]
-                           (csv/write-csv s result :separator \,)
-                           (str s)))
-                "tsv"  (println
-                         (with-open [s (java.io.StringWriter.)]
-                           (csv/write-csv s result :separator \tab)
-                           (str s)))
-                "edn"  (pp/pprint result)
-                ,      (println (json/write-str result json-options))))))))
+    ;; Bound here, so that --stream sees the values after the run:
+    (runtime/with-run-state
+      (fn []
+        (let [[code file load] (get-compiled-forms opts)
+              _ (when (env "YS_SHOW_COMPILE")
+                  (eprint (str line (pretty-clojure code) "\n" line)))
+              streaming (and (:stream opts) (or load (seq (:eval opts))))
+              blank (if (string? code)
+                      (= "" code)
+                      (runtime/blank-forms? code))
+              output (and load (not blank) (not (:print opts)))
+              write-stream (when (and streaming output (streamable? code))
+                             (stream-writer (:to opts)))
+              result (profile/measure "eval"
+                       #(binding [runtime/*after-form*
+                                  (when write-stream
+                                    (fn [] (write-stream false)))]
+                          (if (string? code)
+                            (runtime/eval-string code file args)
+                            (runtime/eval-code code file args))))
+              results (if streaming
+                        @ys.v0.global/stream-values
+                        [result])]
+          (cond
+            (:print opts) (pp/pprint result)
+            write-stream (write-stream true)
+            output (write-results results (:to opts) (> (count results) 1)))
+          (write-profile))))
     (catch Exception e
       (global/reset-error-msg-prefix! "Error: ")
       (err e))))
@@ -550,6 +671,23 @@ Options:
 (defn do-kill [opts args]
   (todo "kill" opts args))
 
+(declare run-main)
+(defn do-server
+  "Serve runs requested by ys-client. Each runs like a ys command with the
+  client's args, environment and working directory, and with RUN describing
+  the client. Everything a run sets up (options, environment, stream values,
+  error prefix) is bound for its own thread, so runs don't see each other."
+  [opts _args]
+  (server/serve (:server opts)
+    (fn [{:keys [args env cwd pid]}]
+      (binding [ys.v0.global/opts (atom {})
+                ys.v0.global/env env
+                ys.v0.common/*cwd* cwd
+                global/error-msg-prefix (atom "Error: ")
+                runtime/*env* env
+                runtime/*run-info* {:args args :pid pid}]
+        (run-main args)))))
+
 (defn elide-empty [opts & keys]
   (reduce
     (fn [opts key]
@@ -559,7 +697,7 @@ Options:
     opts keys))
 
 (def env-opts
-  #{:unordered :print :stack-trace :xtrace})
+  #{:unordered :print :profile :stack-trace :xtrace})
 
 (defn do-default [opts args help]
   (if (or
@@ -611,13 +749,14 @@ Options:
     :to :json :yaml :edn :unordered
     :mode :clojure
     ;:repl :nrepl :kill
-    :debug-stage :stack-trace :xtrace
+    :debug-stage :profile :stack-trace :xtrace
+    :server
     :install :upgrade
     :version :help})
 
 (def action-opts
   #{:run :load :compile
-    :repl :nrepl :kill
+    :repl :nrepl :kill :server
     :version :help})
 
 (def eval-action-opts
@@ -661,7 +800,7 @@ Options:
   (when (and
           (string? file)
           (re-find #"(?:^(?:\ |(?:_?[.:]\w))|\ $|\(|:\ )" file))
-    (if (fs/exists? file)
+    (if (fs/exists? (ys.v0.common/abspath file))
       (err (str "'" file "' looks like an expression,\n"
              "but is also the name of a file. Use --eval or -e."))
       true)))
@@ -672,6 +811,11 @@ Options:
     (if (seq errs)
       (do-error errs)
       (condp #(%1 %2) opts
+        ;; These exec another program or serve, so not from a served run:
+        #(and server/*serving*
+           (some %1 [:server :binary :install :upgrade]))
+        (err (str "Options --server, --binary, --install and --upgrade "
+               "can't be used with ys-client."))
         :help (do-help help)
         :version (do-version)
         :install (do-install opts args)
@@ -683,6 +827,7 @@ Options:
         :repl (do-repl opts)
         :connect (do-connect opts args)
         :kill (do-kill opts args)
+        :server (do-server opts args)
         :nrepl (do-nrepl opts args)
         (do-run opts args)))))
 
@@ -691,8 +836,8 @@ Options:
         file (first argv)
         [filed argv] (if (and file
                            (not (re-find #"^-." file))
-                           (fs/exists? file)
-                           (fs/regular-file? file))
+                           (fs/exists? (ys.v0.common/abspath file))
+                           (fs/regular-file? (ys.v0.common/abspath file)))
                        [file (conj (rest argv) "--" file)]
                        [nil argv])
         [args argv] (split-with #(not= "--" %1) argv)
@@ -740,6 +885,8 @@ Options:
         opts (if (env "YS_STACK_TRACE") (assoc opts :stack-trace true) opts)
         opts (if (env "YS_UNORDERED") (assoc opts :unordered true) opts)
         opts (if (env "YS_XTRACE") (assoc opts :xtrace true) opts)
+        opts (if (and (env "YS_PROFILE") (not (:profile opts)))
+               (assoc opts :profile (env "YS_PROFILE")) opts)
 
         is-e (seq (:eval opts))
         [arg1 arg2] args
@@ -790,16 +937,25 @@ Options:
   (take 2 (get-opts [".foo"]))
   #__)
 
-(defn -main [& argv]
-  (global/reset-env nil)
+(defn run-main
+  "Run a ys command line."
+  [argv]
   (let [[opts args error errs help] (get-opts argv)
         out (:output opts)]
-    (reset! global/opts opts)
-    (if out
-      (with-open [out (io/writer out)]
-        (binding [*out* out]
-          (do-main opts args help error errs)))
-      (do-main opts args help error errs))))
+    (reset! ys.v0.global/opts opts)
+    (binding [profile/*profile* (when (:profile opts) (profile/start))]
+      (if out
+        (with-open [out (io/writer (ys.v0.common/abspath out))]
+          (binding [*out* out]
+            (do-main opts args help error errs)))
+        (do-main opts args help error errs)))))
+
+(defn -main [& argv]
+  (global/reset-env nil)
+  (try
+    (run-main argv)
+    ;; Let the process exit without waiting on the agent thread pools:
+    (finally (shutdown-agents))))
 
 (comment
   )
@@ -0,0 +1,203 @@
+;; Copyright 2023-2026 Ingy dot Net
+;; This code is licensed under MIT license (See License for details)
+
+;; The yamlscript.server library is `ys --server SOCKET`: a resident ys process
+;; that runs ys command lines sent to it over a Unix domain socket, so that
+;; short runs don't pay process startup and runtime setup each time.
+;;
+;; The ys-client program (ys/share/ys-client.c) sends a run request with its
+;; args, environment, working directory and pid, and copies the output to its
+;; own stdout and stderr.
+;;
+;; Every message, both ways, is a frame: a one byte tag, a 4 byte big endian
+;; payload length and the payload.
+;;
+;; Client to server:
+;;   a  one command line arg
+;;   v  one environment entry, NAME=VALUE
+;;   d  the working directory
+;;   p  the client's pid, in decimal
+;;   r  end of the request (empty)
+;;   i  a chunk of stdin, after the server asks for it (empty at EOF)
+;;
+;; Server to client:
+;;   o  a chunk of stdout
+;;   e  a chunk of stderr
+;;   i  send stdin now (empty); sent the first time the run reads stdin
+;;   x  the exit status, in decimal; the last frame
+;;
+;; Each connection is served on its own thread, and runs are evaluated
+;; concurrently: the run function binds the per run state (options, stream
+;; values, environment, working directory) for its thread.
+
+(ns yamlscript.server
+  (:require
+   [clojure.string :as str])
+  (:import
+   (java.io DataInputStream DataOutputStream EOFException InputStream
+            InputStreamReader OutputStream OutputStreamWriter)
+   (java.net StandardProtocolFamily UnixDomainSocketAddress)
+   (java.nio.channels Channels ServerSocketChannel SocketChannel)
+   (java.nio.charset StandardCharsets)
+   (java.nio.file Files Path)
+   (java.util.concurrent ExecutorService Executors))
+  (:refer-clojure))
+
+(def ^:dynamic *serving*
+  "True while a run requested over the server socket is running."
+  false)
+
+(defn exit
+  "End the current run with status n. Used in place of System/exit while
+  *serving*. This throws an Error (with ex-data), so that the ys code that
+  catches Exceptions lets it through like it would an exit."
+  [n]
+  (throw
+    (proxy [Error clojure.lang.IExceptionInfo] [(str "exit " n)]
+      (getData [] {::exit n}))))
+
+(defn- write-frame [^DataOutputStream out tag ^bytes bytes]
+  (locking out
+    (.writeByte out (int tag))
+    (.writeInt out (alength bytes))
+    (.write out bytes)
+    (.flush out)))
+
+(defn- read-frame
+  "Read a frame and return [tag payload-bytes], or nil at end of input."
+  [^DataInputStream in]
+  (let [tag (try (.readUnsignedByte in) (catch EOFException _ nil))]
+    (when tag
+      (let [bytes (byte-array (.readInt in))]
+        (.readFully in bytes)
+        [(char tag) bytes]))))
+
+(defn- utf8 [^bytes bytes]
+  (String. bytes StandardCharsets/UTF_8))
+
+(defn- read-request
+  "Read a run request into a map of :args, :env, :cwd and :pid."
+  [in]
+  (loop [request {:args [] :env {} :cwd nil :pid nil}]
+    (let [[tag bytes :as frame] (read-frame in)]
+      (when-not frame
+        (throw
+          (Exception. "Connection closed before the end of the request")))
+      (case tag
+        \a (recur (update request :args conj (utf8 bytes)))
+        \v (let [[k v] (str/split (utf8 bytes) #"=" 2)]
+             (recur (assoc-in request [:env k] (or v ""))))
+        \d (recur (assoc request :cwd (utf8 bytes)))
+        \p (recur (assoc request :pid (parse-long (utf8 bytes))))
+        \r request
+        (throw (Exception. (str "Bad request frame tag '" tag "'")))))))
+
+(defn- output-stream
+  "An OutputStream that sends what is written to it as tag frames."
+  ^OutputStream [out tag]
+  (proxy [OutputStream] []
+    (write
+      ([b]
+       (if (bytes? b)
+         (write-frame out tag b)
+         (write-frame out tag (byte-array [(unchecked-byte b)]))))
+      ([b off len]
+       (when (pos? len)
+         (write-frame out tag
+           (java.util.Arrays/copyOfRange ^bytes b (int off)
+             (int (+ off len)))))))))
+
+(defn- input-stream
+  "An InputStream of the client's stdin, which it is asked for on the first
+  read."
+  ^InputStream [^DataInputStream in out]
+  (let [state (atom {:asked false :chunk nil :pos 0 :eof false})
+        fill (fn []
+               (let [{:keys [asked ^bytes chunk pos eof]} @state]
+                 (when-not asked
+                   (write-frame out \i (byte-array 0))
+                   (swap! state assoc :asked true))
+                 (if (or eof (and chunk (< pos (alength chunk))))
+                   (not eof)
+                   (let [[tag ^bytes bytes] (read-frame in)]
+                     (if (and (= \i tag) (pos? (alength bytes)))
+                       (do (swap! state assoc :chunk bytes :pos 0) true)
+                       (do (swap! state assoc :eof true) false))))))]
+    (proxy [InputStream] []
+      (read
+        ([]
+         (if (fill)
+           (let [{:keys [^bytes chunk pos]} @state]
+             (swap! state update :pos inc)
+             (bit-and 0xff (aget chunk (int pos))))
+           -1))
+        ([b off len]
+         (cond
+           (zero? len) 0
+           ,
+           (fill)
+           (let [{:keys [^bytes chunk pos]} @state
+                 n (int (min len (- (alength chunk) pos)))]
+             (System/arraycopy chunk (int pos) b (int off) n)
+             (swap! state update :pos + n)
+             n)
+           :else -1))))))
+
+(defn- serve-connection
+  "Read one run request from a connection, run it and send back its output
+  and exit status."
+  [^SocketChannel channel run]
+  (with-open [channel channel]
+    (let [in (DataInputStream. (Channels/newInputStream channel))
+          out (DataOutputStream. (Channels/newOutputStream channel))
+          request (read-request in)
+          stdout (OutputStreamWriter. (output-stream out \o)
+                   StandardCharsets/UTF_8)
+          stderr (OutputStreamWriter. (output-stream out \e)
+                   StandardCharsets/UTF_8)
+          status (binding [*serving* true
+                           *in* (clojure.lang.LineNumberingPushbackReader.
+                                  (InputStreamReader. (input-stream in out)
+                                    StandardCharsets/UTF_8))
+                           *out* stdout
+                           *err* stderr]
+                   (try
+                     (run request)
+                     0
+                     (catch Throwable e
+                       (or (::exit (ex-data e))
+                         (do (binding [*out* *err*] (println (str e)))
+                             1)))
+                     (finally
+                       (.flush stdout)
+                       (.flush stderr))))]
+      (write-frame out \x (.getBytes (str status) StandardCharsets/UTF_8)))))
+
+(defn serve
+  "Serve run requests on the Unix domain socket at path until the process is
+  stopped. run is called with each request map (:args, :env, :cwd and :pid),
+  with *in*, *out* and *err* bound to the client's streams. Requests are run
+  concurrently, each on its own thread."
+  [path run]
+  (let [path (.toAbsolutePath (Path/of (str path) (make-array String 0)))
+        server (ServerSocketChannel/open StandardProtocolFamily/UNIX)
+        ^ExecutorService pool (Executors/newCachedThreadPool)]
+    (Files/deleteIfExists path)
+    (.bind server (UnixDomainSocketAddress/of path))
+    (.addShutdownHook (Runtime/getRuntime)
+      (Thread. #(Files/deleteIfExists path)))
+    (binding [*out* *err*]
+      (println (str "ys server listening on " path)))
+    (loop []
+      (let [channel (.accept server)
+            task (bound-fn []
+                   (try
+                     (serve-connection channel run)
+                     (catch Exception e
+                       (binding [*out* *err*]
+                         (println (str "ys server: " (ex-message e)))))))]
+        (.submit pool ^Runnable task)
+        (recur)))))
+
+(comment
+  )
@@ -42,9 +42,13 @@ HELP =: |
 #                              parse, compose, resolve, build,
 #                              transform, construct, print
 #                            can be used multiple times
+#       --profile FORMAT     Print each stage's time, allocation and size
+#                            to stderr in FORMAT: json
 #   -S, --stack-trace        Print full stack trace for errors
 #   -x, --xtrace             Print each expression before evaluation
 
+#       --server SOCKET      Serve ys runs from ys-client on a Unix socket
+
 #       --install            Install the libys shared library
 #       --upgrade            Upgrade both ys and libys
 
@@ -108,6 +108,14 @@ baz:
 - bbb: 2"
     "Testing the 'load' function to load another YS file")
 
+  (is (ys "--to=csv" "-le" "+[[1 2] [3 \"a,b\"]]")
+    "1,2\n3,\"a,b\""
+    "--to=csv writes each row")
+
+  (is (ys "--to=tsv" "-le" "+[[1 2] [3 4]]")
+    "1\t2\n3\t4"
+    "--to=tsv writes each row")
+
   (like (ys "-pe" "find-ns: quote(str)")
     #"sci\.lang\.Namespace"
     "clojure.string ns available as str")
@@ -191,6 +199,23 @@ tenth: 10"
 
   #__)
 
+;; Output isn't trimmed here, since its trailing newlines are being tested:
+(test/deftest yaml-output-test
+
+  (is (with-out-str (cli/-main "-mb" "-Y" "-e" "a: |+\n  x\n\n\n"))
+    "a: |+\n  x\n"
+    "YAML output ends with one newline, even after a |+ scalar")
+
+  (is (with-out-str (cli/-main "-sY" "-e" "a: |+\n  x\n\n\n---\nb: 2"))
+    "---\na: |+\n  x\n---\nb: 2\n"
+    "--stream writes each document's YAML the same way")
+
+  (is (with-out-str
+        (cli/-main "-sY" "-e"
+          "--- !ys-0\n=>: 1\n--- !ys-0\n=>: stream().count()"))
+    "---\n1\n---\n1\n"
+    "--stream output of a program that reads the stream"))
+
 (swap! cli/testing (constantly true))
 (test/run-tests)
 
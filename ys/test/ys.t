@@ -11,6 +11,18 @@ yaml1 =: |
   bar:: +++.$.foo
   baz: 123
 
+yaml2 =: |
+  # A stream of 3 documents
+  ---
+  a: 1
+  --- |
+    x
+    ---
+    y
+  ...
+  ---
+  c: 3
+
 test::
 - code: yaml1:lines:rest:text:eval:yaml/dump
   want: |
@@ -28,4 +40,27 @@ test::
     - bar: boom
       baz: 123
 
+- code: yaml2:yaml/load-all:count
+  want: 3
+
+- code: yaml2:yaml/load-all:first
+  want:
+    a: 1
+
+- code: yaml2:yaml/load-all:second
+  want: |
+    x
+    ---
+    y
+
+- code: yaml2:yaml/load-all:last
+  want:
+    c: 3
+
+- code: yaml2:yaml/load-all:vector?
+  want: true
+
+- code: yaml/load-all('')
+  want: [null]
+
 done: